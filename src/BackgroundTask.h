@@ -8,6 +8,8 @@
 #include <functional>
 #include <optional>
 #include <chrono>
+#include "CancellationToken.h"
+#include "ThreadPool.h"
 
 enum class TaskStatus {
     SUCCESS,
@@ -16,7 +18,7 @@ enum class TaskStatus {
     ERROR
 };
 
-// Abstract class for background tasks
+// Abstract class for background tasks. Tasks run on the workers of the process-wide ThreadPool.
 template<typename ResultType>
 class BackgroundTask {
 public:
@@ -28,18 +30,34 @@ public:
 
     virtual ~BackgroundTask() {
         Stop();
+
+        // The last reference may be dropped by the callback of the task, whose worker cannot wait for itself
+        if (executing_task != this) {
+            Join();
+        }
     }
 
     // Start the background task with an optional callback
-    bool Run(TaskCallback callback = nullptr) {
-        std::lock_guard<std::mutex> lock(mutex_);
+    bool Run(TaskCallback callback = nullptr, ThreadPool::Priority priority = ThreadPool::Priority::HIGH) {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        // A previous run has already finished, apart from its callback maybe. Waited for without the lock, the
+        // callback may run the task again, in which case it is not waited for at all.
+        if (!is_running && task_future.valid() && executing_task != this) {
+            std::shared_future<void> previous_future = task_future;
+            lock.unlock();
+            previous_future.wait();
+            lock.lock();
+        }
+
         if (!is_running) {
             is_running = true;
             is_cancelled = false;
+            cancellation_token = CancellationToken();
             error_code = TaskStatus::SUCCESS;
             on_complete = callback;  // Store the callback
             try {
-                task_thread = std::thread(&BackgroundTask::ExecuteTask, this);
+                task_future = ThreadPool::GetInstance().Submit([this]() { ExecuteTask(); }, priority).share();
             } catch (...) {
                 is_running = false;
                 error_code = TaskStatus::ERROR;
@@ -50,18 +68,28 @@ public:
         return false;
     }
 
-    // Stop the background task
+    // Ask the background task to stop and return immediately. The task stops at its next cancellation check
+    // and its result is discarded.
     void Stop() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (is_running) {
+            is_cancelled = true;
+            cancellation_token.Cancel();
+            cv.notify_all();
+        }
+    }
+
+    // Wait until the task, including its callback, has finished
+    void Join() {
+        std::shared_future<void> current_future;
+
         {
             std::lock_guard<std::mutex> lock(mutex_);
-            if (is_running) {
-                is_cancelled = true;
-                cv.notify_all();
-            }
+            current_future = task_future;
         }
 
-        if (task_thread.joinable()) {
-            task_thread.join();
+        if (current_future.valid()) {
+            current_future.wait();
         }
     }
 
@@ -90,7 +118,7 @@ public:
         return result;
     }
 
-    // Cancel the running task
+    // Cancel the running task without waiting for it
     void Cancel() {
         Stop();
     }
@@ -99,38 +127,50 @@ protected:
     // Derived classes must implement this method to define the background task
     virtual ResultType Execute() = 0;
 
-    // Method to execute the task in a thread
+    // Method to execute the task on a pool worker
     void ExecuteTask() {
         ResultType task_result;
+        const BackgroundTask* previous_task = executing_task;
+        executing_task = this;
 
         {
-            std::lock_guard<std::mutex> lock(mutex_);
-            if (is_cancelled) {
-                is_running = false;
-                error_code = TaskStatus::CANCELLED;
-                cv.notify_all();
-                return;
+            // The callback may drop the last reference to the task. Nothing but locals and the thread-local
+            // marker are touched once it has been called.
+            TaskCallback callback;
+            TaskStatus status;
+            bool cancelled;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                cancelled = is_cancelled;
             }
-        }
 
-        task_result = Execute();
+            if (!cancelled) {
+                task_result = Execute();
+            }
 
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            if (!is_cancelled) {
-                result = task_result;
-                error_code = TaskStatus::SUCCESS;
-            } else {
-                error_code = TaskStatus::CANCELLED;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!is_cancelled) {
+                    result = task_result;
+                    error_code = TaskStatus::SUCCESS;
+                } else {
+                    error_code = TaskStatus::CANCELLED;
+                }
+                status = error_code;
+                callback = std::move(on_complete);
+                on_complete = nullptr;
+                is_running = false;
             }
-            is_running = false;
-        }
-        cv.notify_all();
+            cv.notify_all();
 
-        // Invoke the callback, if provided
-        if (on_complete) {
-            on_complete(error_code);
+            // Invoke the callback, if provided. A task cancelled before it started does not call it.
+            if (callback && !cancelled) {
+                callback(status);
+            }
         }
+
+        executing_task = previous_task;
     }
 
     TaskCallback on_complete;  // Store the callback
@@ -144,7 +184,12 @@ protected:
 
     std::atomic<bool> is_running;
     std::atomic<bool> is_cancelled;
-    std::thread task_thread;
+    CancellationToken cancellation_token; // Handed to long running work inside Execute
+    std::shared_future<void> task_future;  // Ready when the pool has finished the task
+
+    // Task the current worker runs, including its callback. Thread-local, so it can be reset after the callback
+    // has freed the task.
+    inline static thread_local const BackgroundTask* executing_task = nullptr;
 };
 
 
@@ -0,0 +1,21 @@
+#ifndef POTOPOTO_CANCELLATIONTOKEN_H
+#define POTOPOTO_CANCELLATIONTOKEN_H
+
+#include <atomic>
+#include <memory>
+
+
+// Flag to ask running work to stop at its next check. Copies of a token share the same flag.
+class CancellationToken {
+public:
+    CancellationToken() : cancelled(std::make_shared<std::atomic<bool>>(false)) {}
+
+    void Cancel() { *cancelled = true; }
+    bool IsCancelled() const { return *cancelled; }
+
+private:
+    std::shared_ptr<std::atomic<bool>> cancelled;
+};
+
+
+#endif //POTOPOTO_CANCELLATIONTOKEN_H
@@ -0,0 +1,109 @@
+#include "ColorLookupTable3D.h"
+#include "ThreadPool.h"
+
+
+const int ColorLookupTable3D::LATTICE_SIZE = 33;
+
+
+ColorLookupTable3D::ColorLookupTable3D() {
+    table.resize(LATTICE_SIZE * LATTICE_SIZE * LATTICE_SIZE * 3);
+
+    for (int i = 0; i < 256; ++i) {
+        float position = i * (LATTICE_SIZE - 1) / 255.0f;
+        int index = std::min(static_cast<int>(position), LATTICE_SIZE - 2);
+
+        lattice_index[i] = index;
+        lattice_fraction[i] = cvRound((position - index) * 256.0f);
+    }
+}
+
+
+void ColorLookupTable3D::Bake(const FusedPointwiseKernel& kernel, unsigned int stages) {
+    int thread_count = ThreadPool::GetInstance().GetKernelThreadCount();
+
+#pragma omp parallel for num_threads(thread_count)
+    for (int b = 0; b < LATTICE_SIZE; ++b) {
+        for (int g = 0; g < LATTICE_SIZE; ++g) {
+            for (int r = 0; r < LATTICE_SIZE; ++r) {
+                uchar* entry = &table[((b * LATTICE_SIZE + g) * LATTICE_SIZE + r) * 3];
+
+                entry[0] = cv::saturate_cast<uchar>(r * 255.0f / (LATTICE_SIZE - 1));
+                entry[1] = cv::saturate_cast<uchar>(g * 255.0f / (LATTICE_SIZE - 1));
+                entry[2] = cv::saturate_cast<uchar>(b * 255.0f / (LATTICE_SIZE - 1));
+
+                kernel.ApplyPixel(entry, stages);
+            }
+        }
+    }
+}
+
+
+void ColorLookupTable3D::ApplyPixel(uchar* rgb) const {
+    const int stride_g = LATTICE_SIZE * 3;
+    const int stride_b = LATTICE_SIZE * LATTICE_SIZE * 3;
+
+    int fr = lattice_fraction[rgb[0]];
+    int fg = lattice_fraction[rgb[1]];
+    int fb = lattice_fraction[rgb[2]];
+
+    const uchar* c000 = &table[lattice_index[rgb[2]] * stride_b + lattice_index[rgb[1]] * stride_g +
+                               lattice_index[rgb[0]] * 3];
+    const uchar* c111 = c000 + stride_b + stride_g + 3;
+
+    // Split the lattice cube into six tetrahedra along its main diagonal and pick the one containing the pixel
+    const uchar* c1;
+    const uchar* c2;
+    int w0, w1, w2, w3;
+
+    if (fr > fg) {
+        if (fg > fb) {
+            c1 = c000 + 3; c2 = c000 + 3 + stride_g;
+            w0 = 256 - fr; w1 = fr - fg; w2 = fg - fb; w3 = fb;
+        } else if (fr > fb) {
+            c1 = c000 + 3; c2 = c000 + 3 + stride_b;
+            w0 = 256 - fr; w1 = fr - fb; w2 = fb - fg; w3 = fg;
+        } else {
+            c1 = c000 + stride_b; c2 = c000 + 3 + stride_b;
+            w0 = 256 - fb; w1 = fb - fr; w2 = fr - fg; w3 = fg;
+        }
+    } else {
+        if (fb > fg) {
+            c1 = c000 + stride_b; c2 = c000 + stride_g + stride_b;
+            w0 = 256 - fb; w1 = fb - fg; w2 = fg - fr; w3 = fr;
+        } else if (fb > fr) {
+            c1 = c000 + stride_g; c2 = c000 + stride_g + stride_b;
+            w0 = 256 - fg; w1 = fg - fb; w2 = fb - fr; w3 = fr;
+        } else {
+            c1 = c000 + stride_g; c2 = c000 + 3 + stride_g;
+            w0 = 256 - fg; w1 = fg - fr; w2 = fr - fb; w3 = fb;
+        }
+    }
+
+    for (int channel = 0; channel < 3; ++channel) {
+        int value = w0 * c000[channel] + w1 * c1[channel] + w2 * c2[channel] + w3 * c111[channel];
+        rgb[channel] = static_cast<uchar>((value + 128) >> 8);
+    }
+}
+
+
+bool ColorLookupTable3D::ProcessRegion(cv::Mat& rgb_image, const cv::Rect& region) const {
+    // Input image is RGB - Output image is RGB
+    cv::Rect safe_region = region & cv::Rect(0, 0, rgb_image.cols, rgb_image.rows);
+
+    if (safe_region.empty()) {
+        return false;
+    }
+
+    int thread_count = ThreadPool::GetInstance().GetKernelThreadCount();
+
+#pragma omp parallel for num_threads(thread_count)
+    for (int row = safe_region.y; row < safe_region.y + safe_region.height; ++row) {
+        uchar* pixel = rgb_image.ptr<uchar>(row) + safe_region.x * 3;
+
+        for (int col = 0; col < safe_region.width; ++col, pixel += 3) {
+            ApplyPixel(pixel);
+        }
+    }
+
+    return true;
+}
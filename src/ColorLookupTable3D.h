@@ -0,0 +1,38 @@
+#ifndef POTOPOTO_COLORLOOKUPTABLE3D_H
+#define POTOPOTO_COLORLOOKUPTABLE3D_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "FusedPointwiseKernel.h"
+
+
+// RGB -> RGB lookup table on a regular lattice with tetrahedral interpolation. Baking samples the fused point-wise
+// kernel at the lattice points only (33^3 = 35937 pixels), which is far cheaper than one pass over a preview region.
+class ColorLookupTable3D {
+public:
+    ColorLookupTable3D();
+    ~ColorLookupTable3D() = default;
+
+    void Bake(const FusedPointwiseKernel& kernel, unsigned int stages);
+
+    // Apply the table to a region of an 8-bit, 3 channel RGB image
+    bool ProcessRegion(cv::Mat& rgb_image, const cv::Rect& region) const;
+
+    // Lattice values, RGB interleaved, red varies fastest
+    const std::vector<uchar>& GetTable() const { return table; }
+
+    static const int LATTICE_SIZE;
+
+private:
+    void ApplyPixel(uchar* rgb) const;
+
+private:
+    std::vector<uchar> table;
+
+    // Lattice index and fixed point fraction (8 bit) for each input intensity
+    int lattice_index[256];
+    int lattice_fraction[256];
+};
+
+
+#endif //POTOPOTO_COLORLOOKUPTABLE3D_H
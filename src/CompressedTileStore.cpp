@@ -0,0 +1,163 @@
+#include "CompressedTileStore.h"
+#include "TileCodec.h"
+#include "TiledExecutor.h"
+#include "ThreadPool.h"
+#include <iostream>
+
+
+const int CompressedTileStore::DEFAULT_TILE_SIZE = 256;
+const size_t CompressedTileStore::DEFAULT_CACHE_BYTES = 64 * 1024 * 1024; // About 250 RGBA tiles, several viewports
+
+
+CompressedTileStore::CompressedTileStore(const cv::Mat& image, int my_tile_size, size_t cache_bytes) :
+        size(image.size()), type(image.type()), elem_size(image.elemSize()), tile_size(my_tile_size),
+        compressed_bytes(0), cached_bytes(0), max_cached_bytes(cache_bytes) {
+    tiles_x = (size.width + tile_size - 1) / tile_size;
+
+    // Row-major, so a tile is found from its grid position
+    for (const auto& rect : TiledExecutor::SplitIntoTiles(cv::Rect(0, 0, size.width, size.height), tile_size)) {
+        tiles.push_back({rect, {}});
+    }
+
+    int tile_count = static_cast<int>(tiles.size());
+    int thread_count = ThreadPool::GetInstance().GetKernelThreadCount();
+
+#pragma omp parallel for schedule(dynamic) num_threads(thread_count)
+    for (int i = 0; i < tile_count; ++i) {
+        tiles[i].compressed = EncodeTile(image(tiles[i].rect));
+    }
+
+    for (const auto& tile : tiles) {
+        compressed_bytes += tile.compressed.size();
+    }
+
+    std::cout << "Compressed " << size.width << "x" << size.height << " image into " << tiles.size() << " tiles, "
+              << size.area() * elem_size / 1024 << " KB -> " << compressed_bytes / 1024 << " KB" << std::endl;
+}
+
+
+void CompressedTileStore::Read(const cv::Rect& region, cv::Mat& out) {
+    out.create(region.height, region.width, type);
+
+    cv::Rect clamped_region = region & cv::Rect(0, 0, size.width, size.height);
+
+    if (clamped_region.empty()) {
+        return;
+    }
+
+    int first_x = clamped_region.x / tile_size;
+    int first_y = clamped_region.y / tile_size;
+    int last_x = (clamped_region.x + clamped_region.width - 1) / tile_size;
+    int last_y = (clamped_region.y + clamped_region.height - 1) / tile_size;
+
+    for (int tile_y = first_y; tile_y <= last_y; tile_y++) {
+        for (int tile_x = first_x; tile_x <= last_x; tile_x++) {
+            size_t index = tile_y * tiles_x + tile_x;
+            const cv::Rect& tile_rect = tiles[index].rect;
+            cv::Mat tile = GetTile(index);
+
+            cv::Rect overlap = clamped_region & tile_rect;
+            cv::Rect source_rect(overlap.x - tile_rect.x, overlap.y - tile_rect.y, overlap.width, overlap.height);
+            cv::Rect target_rect(overlap.x - region.x, overlap.y - region.y, overlap.width, overlap.height);
+
+            cv::Mat target = out(target_rect);
+            tile(source_rect).copyTo(target);
+        }
+    }
+}
+
+
+size_t CompressedTileStore::GetCachedBytes() const {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return cached_bytes;
+}
+
+
+cv::Mat CompressedTileStore::GetTile(size_t index) {
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+
+        auto cached = cache_index.find(index);
+        if (cached != cache_index.end()) {
+            cache.splice(cache.begin(), cache, cached->second);
+            return cached->second->second;
+        }
+    }
+
+    // Decompressed outside of the lock, so readers of other tiles do not wait
+    cv::Mat tile(tiles[index].rect.height, tiles[index].rect.width, type);
+
+    if (!DecodeTile(tiles[index].compressed, tile)) {
+        std::cerr << "Failed to decompress tile " << index << std::endl;
+        tile.setTo(cv::Scalar::all(0));
+    }
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+
+    // Another reader may have decompressed the same tile in the meantime
+    if (cache_index.count(index) == 0) {
+        cache.emplace_front(index, tile);
+        cache_index[index] = cache.begin();
+        cached_bytes += tile.total() * elem_size;
+
+        while (cached_bytes > max_cached_bytes && cache.size() > 1) {
+            cached_bytes -= cache.back().second.total() * elem_size;
+            cache_index.erase(cache.back().first);
+            cache.pop_back();
+        }
+    }
+
+    return tile;
+}
+
+
+std::vector<uint8_t> CompressedTileStore::EncodeTile(const cv::Mat& tile) const {
+    // One plane per byte of a pixel, each delta coded against its left neighbour
+    size_t width = tile.cols;
+    size_t height = tile.rows;
+    std::vector<uint8_t> planes(width * height * elem_size);
+
+    for (size_t y = 0; y < height; y++) {
+        const uint8_t* row = tile.ptr<uint8_t>(static_cast<int>(y));
+
+        for (size_t b = 0; b < elem_size; b++) {
+            uint8_t* plane_row = planes.data() + (b * height + y) * width;
+            uint8_t previous = 0;
+
+            for (size_t x = 0; x < width; x++) {
+                uint8_t value = row[x * elem_size + b];
+                plane_row[x] = static_cast<uint8_t>(value - previous);
+                previous = value;
+            }
+        }
+    }
+
+    return TileCodec::Compress(planes.data(), planes.size());
+}
+
+
+bool CompressedTileStore::DecodeTile(const std::vector<uint8_t>& compressed, cv::Mat& tile) const {
+    size_t width = tile.cols;
+    size_t height = tile.rows;
+    std::vector<uint8_t> planes(width * height * elem_size);
+
+    if (!TileCodec::Decompress(compressed, planes.data(), planes.size())) {
+        return false;
+    }
+
+    for (size_t y = 0; y < height; y++) {
+        uint8_t* row = tile.ptr<uint8_t>(static_cast<int>(y));
+
+        for (size_t b = 0; b < elem_size; b++) {
+            const uint8_t* plane_row = planes.data() + (b * height + y) * width;
+            uint8_t previous = 0;
+
+            for (size_t x = 0; x < width; x++) {
+                previous = static_cast<uint8_t>(previous + plane_row[x]);
+                row[x * elem_size + b] = previous;
+            }
+        }
+    }
+
+    return true;
+}
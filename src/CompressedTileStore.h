@@ -0,0 +1,58 @@
+#ifndef POTOPOTO_COMPRESSEDTILESTORE_H
+#define POTOPOTO_COMPRESSEDTILESTORE_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+
+
+// Keeps an image as independently compressed tiles. Before compression a tile is split into byte planes and delta
+// coded along its rows, so constant channels like alpha and smooth areas shrink well. Decompressed tiles are kept
+// in a small working set, least recently used tiles are dropped first.
+class CompressedTileStore {
+public:
+    CompressedTileStore(const cv::Mat& image, int tile_size = DEFAULT_TILE_SIZE, size_t cache_bytes = DEFAULT_CACHE_BYTES);
+
+    cv::Size GetSize() const { return size; }
+    int GetType() const { return type; }
+
+    // Copy the region into out, which gets the size of the region. Safe to call from several threads.
+    void Read(const cv::Rect& region, cv::Mat& out);
+
+    size_t GetCompressedBytes() const { return compressed_bytes; }
+    size_t GetCachedBytes() const;
+
+    static const int DEFAULT_TILE_SIZE;
+    static const size_t DEFAULT_CACHE_BYTES;
+
+private:
+    struct Tile {
+        cv::Rect rect;
+        std::vector<uint8_t> compressed;
+    };
+
+    cv::Mat GetTile(size_t index);
+    std::vector<uint8_t> EncodeTile(const cv::Mat& tile) const;
+    bool DecodeTile(const std::vector<uint8_t>& compressed, cv::Mat& tile) const;
+
+private:
+    std::vector<Tile> tiles;
+    cv::Size size;
+    int type;
+    size_t elem_size;
+    int tile_size;
+    int tiles_x;
+    size_t compressed_bytes;
+
+    std::list<std::pair<size_t, cv::Mat>> cache;    // Most recently used first
+    std::unordered_map<size_t, std::list<std::pair<size_t, cv::Mat>>::iterator> cache_index;
+    size_t cached_bytes;
+    size_t max_cached_bytes;
+    mutable std::mutex cache_mutex;
+};
+
+
+#endif //POTOPOTO_COMPRESSEDTILESTORE_H
@@ -0,0 +1,343 @@
+#include "FusedPointwiseKernel.h"
+#include "ThreadPool.h"
+#include <cfloat>
+
+
+const int FusedPointwiseKernel::MAX_DEVIATION = 1;
+const int FusedPointwiseKernel::ROW_BLOCK_BYTES = 256 * 1024; // Roughly the size of a per-core L2 cache
+
+
+// Fixed point tables used by OpenCV's 8-bit RGB -> HSV conversion
+static const int HSV_SHIFT = 12;
+
+struct HsvDivisionTables {
+    int saturation[256];
+    int hue[256];
+
+    HsvDivisionTables() {
+        saturation[0] = 0;
+        hue[0] = 0;
+
+        for (int i = 1; i < 256; ++i) {
+            saturation[i] = cv::saturate_cast<int>((255 << HSV_SHIFT) / (1.0 * i));
+            hue[i] = cv::saturate_cast<int>((180 << HSV_SHIFT) / (6.0 * i));
+        }
+    }
+};
+
+static const HsvDivisionTables& GetHsvDivisionTables() {
+    static const HsvDivisionTables tables;
+    return tables;
+}
+
+
+// Maps a hue sector to the (b, g, r) indexes of the {p, q, t, u} table used by the HSV and HLS back conversions
+static const int HUE_SECTOR_DATA[][3] = {{1, 3, 0}, {1, 0, 2}, {3, 0, 1}, {0, 2, 1}, {0, 1, 3}, {2, 1, 0}};
+
+
+static int HueSector(float& h) {
+    if (h < 0) {
+        do h += 6; while (h < 0);
+    } else if (h >= 6) {
+        do h -= 6; while (h >= 6);
+    }
+
+    int sector = cvFloor(h);
+    h -= sector;
+
+    if ((unsigned) sector >= 6u) {
+        sector = 0;
+        h = 0.f;
+    }
+
+    return sector;
+}
+
+
+FusedPointwiseKernel::FusedPointwiseKernel() {
+    SetParameters(AdjustmentsParameters());
+}
+
+
+void FusedPointwiseKernel::SetParameters(const AdjustmentsParameters& parameters) {
+    active_stages = STAGE_NONE;
+
+    // Brightness and contrast (same combined scale and offset as LayerBrightnessContrast)
+    float brightness = parameters.GetBrightness();
+    float contrast = parameters.GetContrast();
+    float alpha = contrast * brightness;
+    float beta = 128 * (1 - contrast);
+
+    for (int i = 0; i < 256; ++i) {
+        brightness_contrast_table[i] = cv::saturate_cast<uchar>(i * alpha + beta);
+    }
+
+    if (brightness != LayerBrightnessContrast::DEFAULT_BRIGHTNESS || contrast != LayerBrightnessContrast::DEFAULT_CONTRAST) {
+        active_stages |= STAGE_BRIGHTNESS_CONTRAST;
+    }
+
+    // Hue, saturation and value
+    hue = parameters.GetHue();
+    saturation = parameters.GetSaturation();
+    value = parameters.GetValue();
+
+    if (hue != LayerHueSaturationValue::DEFAULT_HUE || saturation != LayerHueSaturationValue::DEFAULT_SATURATION ||
+        value != LayerHueSaturationValue::DEFAULT_VALUE) {
+        active_stages |= STAGE_HUE_SATURATION_VALUE;
+    }
+
+    // Lightness
+    lightness = parameters.GetLightness();
+
+    if (lightness != LayerLightness::DEFAULT_LIGHTNESS) {
+        active_stages |= STAGE_LIGHTNESS;
+    }
+
+    // Gamma (same lookup table as LayerGamma)
+    float gamma = parameters.GetGamma();
+
+    for (int i = 0; i < 256; ++i) {
+        gamma_table[i] = cv::saturate_cast<uchar>(pow(i / 255.0, gamma) * 255.0);
+    }
+
+    if (gamma != LayerGamma::DEFAULT_GAMMA) {
+        active_stages |= STAGE_GAMMA;
+    }
+
+    // CMYK
+    cyan = parameters.GetCyan();
+    magenta = parameters.GetMagenta();
+    yellow = parameters.GetYellow();
+    black = parameters.GetBlack();
+
+    if (cyan != LayerCmyk::DEFAULT_CYAN || magenta != LayerCmyk::DEFAULT_MAGENTA ||
+        yellow != LayerCmyk::DEFAULT_YELLOW || black != LayerCmyk::DEFAULT_BLACK) {
+        active_stages |= STAGE_CMYK;
+    }
+}
+
+
+void FusedPointwiseKernel::ApplyPixel(uchar* rgb, unsigned int stages) const {
+    stages &= active_stages;
+
+    int r = rgb[0];
+    int g = rgb[1];
+    int b = rgb[2];
+
+    if (stages & STAGE_BRIGHTNESS_CONTRAST) {
+        r = brightness_contrast_table[r];
+        g = brightness_contrast_table[g];
+        b = brightness_contrast_table[b];
+    }
+
+    if (stages & STAGE_HUE_SATURATION_VALUE) {
+        ApplyHueSaturationValue(r, g, b);
+    }
+
+    if (stages & STAGE_LIGHTNESS) {
+        ApplyLightness(r, g, b);
+    }
+
+    if (stages & STAGE_GAMMA) {
+        r = gamma_table[r];
+        g = gamma_table[g];
+        b = gamma_table[b];
+    }
+
+    if (stages & STAGE_CMYK) {
+        ApplyCmyk(r, g, b);
+    }
+
+    rgb[0] = static_cast<uchar>(r);
+    rgb[1] = static_cast<uchar>(g);
+    rgb[2] = static_cast<uchar>(b);
+}
+
+
+void FusedPointwiseKernel::ApplyHueSaturationValue(int& r, int& g, int& b) const {
+    // RGB -> HSV, fixed point as in cv::COLOR_RGB2HSV for 8-bit images
+    const HsvDivisionTables& tables = GetHsvDivisionTables();
+
+    int v = std::max(std::max(r, g), b);
+    int vmin = std::min(std::min(r, g), b);
+    int diff = v - vmin;
+    int vr = v == r ? -1 : 0;
+    int vg = v == g ? -1 : 0;
+
+    int s = (diff * tables.saturation[v] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+    int h = (vr & (g - b)) + (~vr & ((vg & (b - r + 2 * diff)) + ((~vg) & (r - g + 4 * diff))));
+    h = (h * tables.hue[diff] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+    h += h < 0 ? 180 : 0;
+
+    // Adjust and clamp the channels as LayerHueSaturationValue does
+    if (hue != LayerHueSaturationValue::DEFAULT_HUE) {
+        h = std::min<int>(cv::saturate_cast<uchar>(h + hue), 180);
+    }
+
+    if (saturation != LayerHueSaturationValue::DEFAULT_SATURATION) {
+        s = cv::saturate_cast<uchar>(s + saturation);
+    }
+
+    if (value != LayerHueSaturationValue::DEFAULT_VALUE) {
+        v = cv::saturate_cast<uchar>(v + value);
+    }
+
+    // HSV -> RGB, floating point as in cv::COLOR_HSV2RGB for 8-bit images
+    float hf = h * (6.f / 180.f);
+    float sf = s * (1.f / 255.f);
+    float vf = v * (1.f / 255.f);
+    float bf, gf, rf;
+
+    if (sf == 0) {
+        bf = gf = rf = vf;
+    } else {
+        int sector = HueSector(hf);
+
+        float tab[4];
+        tab[0] = vf;
+        tab[1] = vf * (1.f - sf);
+        tab[2] = vf * (1.f - sf * hf);
+        tab[3] = vf * (1.f - sf * (1.f - hf));
+
+        bf = tab[HUE_SECTOR_DATA[sector][0]];
+        gf = tab[HUE_SECTOR_DATA[sector][1]];
+        rf = tab[HUE_SECTOR_DATA[sector][2]];
+    }
+
+    r = cv::saturate_cast<uchar>(rf * 255.f);
+    g = cv::saturate_cast<uchar>(gf * 255.f);
+    b = cv::saturate_cast<uchar>(bf * 255.f);
+}
+
+
+void FusedPointwiseKernel::ApplyLightness(int& r, int& g, int& b) const {
+    // RGB -> HLS, floating point as in cv::COLOR_RGB2HLS for 8-bit images
+    float rf = r * (1.f / 255.f);
+    float gf = g * (1.f / 255.f);
+    float bf = b * (1.f / 255.f);
+
+    float vmax = rf;
+    float vmin = rf;
+    if (vmax < gf) vmax = gf;
+    if (vmax < bf) vmax = bf;
+    if (vmin > gf) vmin = gf;
+    if (vmin > bf) vmin = bf;
+
+    float diff = vmax - vmin;
+    float hf = 0.f;
+    float sf = 0.f;
+    float lf = (vmax + vmin) * 0.5f;
+
+    if (diff > FLT_EPSILON) {
+        sf = lf < 0.5f ? diff / (vmax + vmin) : diff / (2 - vmax - vmin);
+        diff = 60.f / diff;
+
+        if (vmax == rf) {
+            hf = (gf - bf) * diff;
+        } else if (vmax == gf) {
+            hf = (bf - rf) * diff + 120.f;
+        } else {
+            hf = (rf - gf) * diff + 240.f;
+        }
+
+        if (hf < 0.f) {
+            hf += 360.f;
+        }
+    }
+
+    int h = cv::saturate_cast<uchar>(hf * 0.5f);
+    int l = cv::saturate_cast<uchar>(lf * 255.f);
+    int s = cv::saturate_cast<uchar>(sf * 255.f);
+
+    // Adjust the lightness channel as LayerLightness does
+    l = cv::saturate_cast<uchar>(l + lightness);
+
+    // HLS -> RGB, floating point as in cv::COLOR_HLS2RGB for 8-bit images
+    hf = h * (6.f / 180.f);
+    lf = l * (1.f / 255.f);
+    sf = s * (1.f / 255.f);
+
+    if (sf == 0) {
+        bf = gf = rf = lf;
+    } else {
+        float p2 = lf <= 0.5f ? lf * (1 + sf) : lf + sf - lf * sf;
+        float p1 = 2 * lf - p2;
+        int sector = HueSector(hf);
+
+        float tab[4];
+        tab[0] = p2;
+        tab[1] = p1;
+        tab[2] = p1 + (p2 - p1) * (1 - hf);
+        tab[3] = p1 + (p2 - p1) * hf;
+
+        bf = tab[HUE_SECTOR_DATA[sector][0]];
+        gf = tab[HUE_SECTOR_DATA[sector][1]];
+        rf = tab[HUE_SECTOR_DATA[sector][2]];
+    }
+
+    r = cv::saturate_cast<uchar>(rf * 255.f);
+    g = cv::saturate_cast<uchar>(gf * 255.f);
+    b = cv::saturate_cast<uchar>(bf * 255.f);
+}
+
+
+void FusedPointwiseKernel::ApplyCmyk(int& r, int& g, int& b) const {
+    // RGB -> CMYK as in ImageUtils::RgbToCmyk
+    float c = 1.f - r * (1.f / 255.f);
+    float m = 1.f - g * (1.f / 255.f);
+    float y = 1.f - b * (1.f / 255.f);
+    float k = std::min(std::min(c, m), y);
+
+    if (k == 1.f) {
+        c = m = y = 0.f;
+    } else {
+        float inverse_k = 1.f - k;
+        c = (c - k) / inverse_k;
+        m = (m - k) / inverse_k;
+        y = (y - k) / inverse_k;
+    }
+
+    // Adjust the channels as LayerCmyk does
+    c += cyan;
+    m += magenta;
+    y += yellow;
+    k += black;
+
+    // CMYK -> RGB as in ImageUtils::CmykToRgb
+    float inverse_k = 1.f - k;
+    r = cv::saturate_cast<uchar>((1.f - c) * inverse_k * 255.f);
+    g = cv::saturate_cast<uchar>((1.f - m) * inverse_k * 255.f);
+    b = cv::saturate_cast<uchar>((1.f - y) * inverse_k * 255.f);
+}
+
+
+bool FusedPointwiseKernel::ProcessRegion(cv::Mat& rgb_image, const cv::Rect& region, unsigned int stages) const {
+    // Input image is RGB - Output image is RGB
+    stages &= active_stages;
+    cv::Rect safe_region = region & cv::Rect(0, 0, rgb_image.cols, rgb_image.rows);
+
+    if (stages == STAGE_NONE || safe_region.empty()) {
+        return false; // No adjustment needed
+    }
+
+    // Walk the region in blocks of rows that fit into the cache. Each pixel runs through all stages at once.
+    int rows_per_block = std::max(1, ROW_BLOCK_BYTES / (safe_region.width * 3));
+    int block_count = (safe_region.height + rows_per_block - 1) / rows_per_block;
+    int thread_count = ThreadPool::GetInstance().GetKernelThreadCount();
+
+#pragma omp parallel for schedule(dynamic) num_threads(thread_count)
+    for (int block = 0; block < block_count; ++block) {
+        int row_start = safe_region.y + block * rows_per_block;
+        int row_end = std::min(row_start + rows_per_block, safe_region.y + safe_region.height);
+
+        for (int row = row_start; row < row_end; ++row) {
+            uchar* pixel = rgb_image.ptr<uchar>(row) + safe_region.x * 3;
+
+            for (int col = 0; col < safe_region.width; ++col, pixel += 3) {
+                ApplyPixel(pixel, stages);
+            }
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,64 @@
+#ifndef POTOPOTO_FUSEDPOINTWISEKERNEL_H
+#define POTOPOTO_FUSEDPOINTWISEKERNEL_H
+
+#include <opencv2/opencv.hpp>
+#include "AdjustmentsParameters.h"
+
+
+// Applies all point-wise adjustment stages (brightness/contrast, HSV, HLS lightness, gamma and CMYK) in a single
+// pass over the pixels. Every stage reproduces the 8-bit arithmetic of the corresponding layer, including the
+// quantisation between stages, so the output matches the layer-by-layer pipeline within MAX_DEVIATION intensity
+// levels per channel and per active stage (differences only come from rounding in OpenCV's vectorised code paths).
+class FusedPointwiseKernel {
+public:
+    // Point-wise stages in pipeline order. Used as a bit mask.
+    enum Stage : unsigned int {
+        STAGE_NONE = 0,
+        STAGE_BRIGHTNESS_CONTRAST = 1 << 0,
+        STAGE_HUE_SATURATION_VALUE = 1 << 1,
+        STAGE_LIGHTNESS = 1 << 2,
+        STAGE_GAMMA = 1 << 3,
+        STAGE_CMYK = 1 << 4,
+        STAGE_ALL = STAGE_BRIGHTNESS_CONTRAST | STAGE_HUE_SATURATION_VALUE | STAGE_LIGHTNESS | STAGE_GAMMA | STAGE_CMYK,
+    };
+
+    FusedPointwiseKernel();
+    ~FusedPointwiseKernel() = default;
+
+    void SetParameters(const AdjustmentsParameters& parameters);
+
+    // Stages whose parameters differ from their defaults
+    unsigned int GetActiveStages() const { return active_stages; }
+
+    // Apply the given stages to a single RGB pixel in place
+    void ApplyPixel(uchar* rgb, unsigned int stages) const;
+
+    // Apply the given stages to a region of an 8-bit, 3 channel RGB image. Returns false if there was nothing to do.
+    bool ProcessRegion(cv::Mat& rgb_image, const cv::Rect& region, unsigned int stages) const;
+
+    static const int MAX_DEVIATION;
+    static const int ROW_BLOCK_BYTES;
+
+private:
+    void ApplyHueSaturationValue(int& r, int& g, int& b) const;
+    void ApplyLightness(int& r, int& g, int& b) const;
+    void ApplyCmyk(int& r, int& g, int& b) const;
+
+private:
+    unsigned int active_stages;
+
+    uchar brightness_contrast_table[256];
+    uchar gamma_table[256];
+
+    float hue;
+    float saturation;
+    float value;
+    float lightness;
+    float cyan;
+    float magenta;
+    float yellow;
+    float black;
+};
+
+
+#endif //POTOPOTO_FUSEDPOINTWISEKERNEL_H
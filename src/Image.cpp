@@ -5,8 +5,47 @@
 
 Image::Image(const std::shared_ptr<cv::UMat>& in_image) {
     original_image = in_image;
-    adjusted_image = std::make_shared<cv::UMat>(original_image->clone());
 
+    // Nothing is adjusted yet, the adjusted image shares the original pixels until its tiles are written
+    adjusted_pixels = PixelBuffer(*original_image);
+
+    CreateLayers();
+
+    counts_original = true;
+    memory_handle = MemoryBudget::GetInstance().Register(MemoryBudget::Category::IMAGE, GetMemoryUsage());
+
+    UpdateImageInfo();
+}
+
+
+Image::Image(const std::shared_ptr<CompressedTileStore>& in_store) :
+        Image(in_store->GetSize(), in_store->GetType(), GetStoreTileSource(in_store)) {
+    original_store = in_store;
+
+    // Registered by the delegated constructor, which did not know the store yet
+    std::lock_guard<std::mutex> buffer_lock(buffer_mutex);
+    MemoryBudget::GetInstance().Update(memory_handle, GetMemoryUsage());
+}
+
+
+Image::Image(const cv::Size& size, int type, PixelBuffer::TileSource in_source) {
+    original_source = std::move(in_source);
+    original_size = size;
+    original_type = type;
+
+    // Unwritten tiles of the adjusted image are read from the original when they are needed
+    adjusted_pixels = PixelBuffer(original_size, original_type, GetOriginalTileSource());
+
+    CreateLayers();
+
+    counts_original = true;
+    memory_handle = MemoryBudget::GetInstance().Register(MemoryBudget::Category::IMAGE, GetMemoryUsage());
+
+    UpdateImageInfo();
+}
+
+
+void Image::CreateLayers() {
     brightness_contrast_adjustments_layer = std::make_shared<LayerBrightnessContrast>();
     hsv_adjustments_layer = std::make_shared<LayerHueSaturationValue>();
     lightness_adjustments_layer = std::make_shared<LayerLightness>();
@@ -16,19 +55,112 @@ Image::Image(const std::shared_ptr<cv::UMat>& in_image) {
     highlight_adjustments_layer = std::make_shared<LayerHighlight>();
     cmyk_adjustments_layer = std::make_shared<LayerCmyk>();
 
-    parameters = std::make_shared<AdjustmentsParameters>();
+    execution_mode = ExecutionMode::FUSED;
+    fused_kernel = std::make_shared<FusedPointwiseKernel>();
+    layer_cache = std::make_shared<LayerOutputCache>();
 
-    UpdateImageInfo();
+    parameters = std::make_shared<AdjustmentsParameters>();
 }
 
 
 Image::~Image() {
-    original_image->release();
-    adjusted_image->release();
+    MemoryBudget::GetInstance().Unregister(memory_handle);
+
+    if (original_image) {
+        original_image->release();
+    }
+}
+
+
+void Image::SetMemoryCategory(MemoryBudget::Category category, bool evictable, bool counts_original_in) {
+    std::lock_guard<std::mutex> buffer_lock(buffer_mutex);
+
+    counts_original = counts_original_in;
+
+    MemoryBudget& memory_budget = MemoryBudget::GetInstance();
+    memory_budget.Unregister(memory_handle);
+    memory_handle = memory_budget.Register(category, GetMemoryUsage(), evictable);
+}
+
+
+size_t Image::GetMemoryUsage() const {
+    // Expects buffer_mutex to be held by the caller. Shared tiles are counted by the image that owns them.
+    size_t original_bytes = 0;
+
+    // Originals read from another source than a store, e.g. a scratch file, are not held by the image
+    if (counts_original && original_store) {
+        original_bytes = original_store->GetCompressedBytes() + original_store->GetCachedBytes();
+    } else if (counts_original && original_image) {
+        original_bytes = original_image->total() * original_image->elemSize();
+    }
+
+    return original_bytes + adjusted_pixels.GetPrivateBytes();
+}
+
+
+void Image::CompressOriginal() {
+    if (!original_image) {
+        return;
+    }
+
+    // Compressed outside of the locks, the original is never written
+    auto store = std::make_shared<CompressedTileStore>(original_image->getMat(cv::ACCESS_READ));
+
+    std::lock_guard<std::mutex> lock(processing_mutex);
+    std::lock_guard<std::mutex> buffer_lock(buffer_mutex);
+
+    original_store = store;
+    original_source = GetStoreTileSource(store);
+    original_size = store->GetSize();
+    original_type = store->GetType();
+    original_image.reset();
+
+    // Unwritten tiles of the adjusted image still point into the uncompressed original
+    adjusted_pixels.ReplaceBorrowedTiles(GetOriginalTileSource());
+
+    MemoryBudget::GetInstance().Update(memory_handle, GetMemoryUsage());
+}
+
+
+cv::UMat Image::ReadOriginal(const cv::Rect& region) const {
+    if (original_image) {
+        return (*original_image)(region);
+    }
+
+    cv::UMat original_region(region.size(), original_type);
+    original_source(region, original_region);
+    return original_region;
+}
+
+
+PixelBuffer::TileSource Image::GetOriginalTileSource() const {
+    // Holds the store or the mapping, not the image, so buffers copied into clones stay valid
+    return original_source;
+}
+
+
+PixelBuffer::TileSource Image::GetStoreTileSource(const std::shared_ptr<CompressedTileStore>& store) {
+    return [store](const cv::Rect& region, cv::UMat& pixels) {
+        cv::Mat tile;
+        store->Read(region, tile);
+        tile.copyTo(pixels);
+    };
+}
+
+
+std::shared_ptr<cv::UMat> Image::GetOriginalImage() const {
+    if (original_image) {
+        return original_image;
+    }
+
+    return std::make_shared<cv::UMat>(ReadOriginal(cv::Rect(0, 0, GetWidth(), GetHeight())));
 }
 
 
 void Image::AdjustParameters(std::shared_ptr<AdjustmentsParameters> parameters_in) {
+    // Waits for a running pipeline, cancel it first to keep this short
+    std::lock_guard<std::mutex> lock(processing_mutex);
+
     if (parameters_in == parameters) {
         parameters_changed = false;
         return;
@@ -55,19 +187,32 @@ void Image::AdjustParameters(std::shared_ptr<AdjustmentsParameters> parameters_i
     cmyk_adjustments_layer->SetYellow(parameters_in->GetYellow());
     cmyk_adjustments_layer->SetBlack(parameters_in->GetBlack());
 
+    fused_kernel->SetParameters(*parameters_in);
+    lookup_tables.clear(); // Baked lazily for the new parameters
+
     parameters = parameters_in;
     parameters_changed = true;
 }
 
 
-bool Image::ApplyAdjustments() {
-    return ApplyAdjustmentsRegion(cv::Rect(0, 0, adjusted_image->cols, adjusted_image->rows));
+void Image::SetExecutionMode(ExecutionMode mode) {
+    // Waits for a running pipeline, like AdjustParameters
+    std::lock_guard<std::mutex> lock(processing_mutex);
+    execution_mode = mode;
 }
 
 
-bool Image::ApplyAdjustmentsRegion(const cv::Rect& region) {
+bool Image::ApplyAdjustments(const CancellationToken& cancellation_token) {
+    return ApplyAdjustmentsRegion(cv::Rect(0, 0, GetWidth(), GetHeight()), cancellation_token);
+}
+
+
+bool Image::ApplyAdjustmentsRegion(const cv::Rect& region, const CancellationToken& cancellation_token) {
+    // A cancelled run of the previous parameters gives up the lock at its next check
+    std::lock_guard<std::mutex> lock(processing_mutex);
+
     // No need to run the pipeline if the parameters have not changed
-    if (!parameters_changed) {
+    if (!parameters_changed || cancellation_token.IsCancelled()) {
         return false;
     }
 
@@ -75,69 +220,403 @@ bool Image::ApplyAdjustmentsRegion(const cv::Rect& region) {
     cv::Rect regionClamped = region;
     regionClamped.x = std::max(0, regionClamped.x);
     regionClamped.y = std::max(0, regionClamped.y);
-    regionClamped.width = std::min(regionClamped.width, adjusted_image->cols - regionClamped.x);
-    regionClamped.height = std::min(regionClamped.height, adjusted_image->rows - regionClamped.y);
+    regionClamped.width = std::min(regionClamped.width, GetWidth() - regionClamped.x);
+    regionClamped.height = std::min(regionClamped.height, GetHeight() - regionClamped.y);
 
-    bool image_changed = false;
+    if (regionClamped.empty()) {
+        return false;
+    }
 
     // This pipeline operates on RGB color space. Input image is however, RGBA.
     // The alpha channel is ignored in this pipeline.
-    // Convert the image to RGB color space
+    // Only the region is converted, processed and written back. The rest of the adjusted image is left untouched.
     auto rgb_image = std::make_shared<cv::UMat>();
-    cv::cvtColor(*original_image, *rgb_image, cv::COLOR_BGRA2BGR);
+    cv::cvtColor(ReadOriginal(regionClamped), *rgb_image, cv::COLOR_BGRA2BGR);
 
-    brightness_contrast_adjustments_layer->SetImage(rgb_image);
-    image_changed = brightness_contrast_adjustments_layer->ApplyRegion(regionClamped) || image_changed;
+    bool image_changed = RunPipeline(rgb_image, regionClamped, cancellation_token);
 
-    hsv_adjustments_layer->SetImage(rgb_image);
-    image_changed = hsv_adjustments_layer->ApplyRegion(regionClamped) || image_changed;
+    // Discard the partial result, the adjusted image keeps its previous content
+    if (cancellation_token.IsCancelled()) {
+        return false;
+    }
 
-    lightness_adjustments_layer->SetImage(rgb_image);
-    image_changed = lightness_adjustments_layer->ApplyRegion(regionClamped) || image_changed;
+    // Convert the region back to RGBA color space
+    cv::UMat adjusted_region;
+    cv::cvtColor(*rgb_image, adjusted_region, cv::COLOR_BGR2BGRA);
 
-    white_balance_adjustments_layer->SetImage(rgb_image);
-    image_changed = white_balance_adjustments_layer->ApplyRegion(regionClamped) || image_changed;
+    if (regionClamped == cv::Rect(0, 0, GetWidth(), GetHeight())) {
+        // A full run replaces the buffer, images sharing the previous one keep their pixels
+        std::lock_guard<std::mutex> buffer_lock(buffer_mutex);
+        adjusted_pixels = PixelBuffer(adjusted_region, true);
+        MemoryBudget::GetInstance().Update(memory_handle, GetMemoryUsage());
+        parameters_changed = false;
+    } else {
+        // Only the tiles of the region are copied if they are shared. The rest of the image still has to be
+        // processed with these parameters.
+        std::lock_guard<std::mutex> buffer_lock(buffer_mutex);
+        adjusted_pixels.Write(regionClamped, adjusted_region);
+        MemoryBudget::GetInstance().Update(memory_handle, GetMemoryUsage());
+    }
 
-    gamma_adjustments_layer->SetImage(rgb_image);
-    image_changed = gamma_adjustments_layer->ApplyRegion(regionClamped) || image_changed;
+    last_adjustment_time = std::chrono::system_clock::now();
 
-    shadow_adjustments_layer->SetImage(rgb_image);
-    image_changed = shadow_adjustments_layer->ApplyRegion(regionClamped) || image_changed;
+    return image_changed;
+}
 
-    highlight_adjustments_layer->SetImage(rgb_image);
-    image_changed = highlight_adjustments_layer->ApplyRegion(regionClamped) || image_changed;
 
-    cmyk_adjustments_layer->SetImage(rgb_image);
-    image_changed = cmyk_adjustments_layer->ApplyRegion(regionClamped) || image_changed;
+std::vector<Image::PipelineStep> Image::BuildPipelineSteps() {
+    // In LAYERED mode every active layer is a step of its own. In FUSED and LUT modes, consecutive point-wise layers
+    // are collected into one tile-parallel step run by the fused kernel or a baked lookup table. Only the layers that
+    // need statistics or neighbourhoods (white balance, shadow, highlight) break the chain. Layers at their defaults
+    // are left out entirely.
+    std::vector<PipelineStep> steps;
+    bool fuse = execution_mode != ExecutionMode::LAYERED;
+    unsigned int active_stages = fused_kernel->GetActiveStages();
+    unsigned int pending_stages = FusedPointwiseKernel::STAGE_NONE;
+    std::vector<float> pending_key;
+
+    auto add_layer_step = [&steps](const std::shared_ptr<LayerBase>& layer, std::vector<float> key) {
+        PipelineStep step;
+        step.key = std::move(key);
+        step.apply = [layer](const std::shared_ptr<cv::UMat>& rgb_image, const cv::Rect& region) {
+            layer->SetImage(rgb_image);
+            return layer->ApplyRegion(region);
+        };
+        steps.push_back(step);
+    };
+
+    auto flush_pointwise_stages = [&]() {
+        if (pending_stages == FusedPointwiseKernel::STAGE_NONE) {
+            return;
+        }
+
+        PipelineStep step;
+        step.key = pending_key;
+        step.key.push_back(static_cast<float>(pending_stages));
+
+        if (execution_mode == ExecutionMode::LUT) {
+            // Bake up front, the tiles must not race on the table cache
+            std::shared_ptr<ColorLookupTable3D> lookup_table = GetLookupTable(pending_stages);
+            step.apply_tile = [lookup_table](cv::Mat& rgb_image, const cv::Rect& tile) {
+                lookup_table->ProcessRegion(rgb_image, tile);
+            };
+        } else {
+            std::shared_ptr<FusedPointwiseKernel> kernel = fused_kernel;
+            unsigned int stages = pending_stages;
+            step.apply_tile = [kernel, stages](cv::Mat& rgb_image, const cv::Rect& tile) {
+                kernel->ProcessRegion(rgb_image, tile, stages);
+            };
+        }
+
+        steps.push_back(step);
+
+        pending_stages = FusedPointwiseKernel::STAGE_NONE;
+        pending_key.clear();
+    };
+
+    auto add_pointwise = [&](unsigned int stage, const std::shared_ptr<LayerBase>& layer, std::vector<float> key) {
+        if (!(active_stages & stage)) {
+            return;
+        }
+
+        if (fuse) {
+            pending_stages |= stage;
+            pending_key.insert(pending_key.end(), key.begin(), key.end());
+        } else {
+            add_layer_step(layer, key);
+        }
+    };
+
+    auto add_layer = [&](bool active, const std::shared_ptr<LayerBase>& layer, std::vector<float> key) {
+        if (!active) {
+            return;
+        }
+
+        flush_pointwise_stages();
+        add_layer_step(layer, key);
+    };
+
+    auto add_white_balance = [&](std::vector<float> key) {
+        float threshold = parameters->GetWhiteBalanceSaturationThreshold();
+
+        if (threshold == LayerWhiteBalance::DEFAULT_SATURATION_THRESHOLD) {
+            return;
+        }
+
+        if (!fuse) {
+            add_layer_step(white_balance_adjustments_layer, key);
+            return;
+        }
+
+        // Gains are measured over the whole region, then applied per tile together with the following stages
+        flush_pointwise_stages();
+
+        // Measured, or taken from the reference statistics
+        auto gains = std::make_shared<cv::Vec2f>(1.0f, 1.0f);
+        std::shared_ptr<LayerWhiteBalance> layer = white_balance_adjustments_layer;
+        PipelineStep step;
+        step.key = std::move(key);
+        step.prepare = [gains, layer](const std::shared_ptr<cv::UMat>& rgb_image, const cv::Rect& region) {
+            *gains = layer->MeasureGains((*rgb_image)(region));
+        };
+        step.apply_tile = [gains](cv::Mat& rgb_image, const cv::Rect& tile) {
+            LayerWhiteBalance::ApplyGains(rgb_image, tile, *gains);
+        };
+        steps.push_back(step);
+    };
+
+    // Each key starts with the position of the layer in the pipeline, followed by its parameters
+    add_pointwise(FusedPointwiseKernel::STAGE_BRIGHTNESS_CONTRAST, brightness_contrast_adjustments_layer,
+                  {0, parameters->GetBrightness(), parameters->GetContrast()});
+    add_pointwise(FusedPointwiseKernel::STAGE_HUE_SATURATION_VALUE, hsv_adjustments_layer,
+                  {1, parameters->GetHue(), parameters->GetSaturation(), parameters->GetValue()});
+    add_pointwise(FusedPointwiseKernel::STAGE_LIGHTNESS, lightness_adjustments_layer,
+                  {2, parameters->GetLightness()});
+    add_white_balance({3, parameters->GetWhiteBalanceSaturationThreshold()});
+    add_pointwise(FusedPointwiseKernel::STAGE_GAMMA, gamma_adjustments_layer,
+                  {4, parameters->GetGamma()});
+    // The shadow and highlight masks go through a distance transform that is normalised over the whole region.
+    // Its support is unbounded, so no finite tile halo can reproduce it and these layers run on the whole region.
+    add_layer(parameters->GetShadow() != LayerShadow::DEFAULT_SHADOW,
+              shadow_adjustments_layer, {5, parameters->GetShadow()});
+    add_layer(parameters->GetHighlight() != LayerHighlight::DEFAULT_HIGHLIGHT,
+              highlight_adjustments_layer, {6, parameters->GetHighlight()});
+    add_pointwise(FusedPointwiseKernel::STAGE_CMYK, cmyk_adjustments_layer,
+                  {7, parameters->GetCyan(), parameters->GetMagenta(), parameters->GetYellow(), parameters->GetBlack()});
+    flush_pointwise_stages();
+
+    return steps;
+}
 
-    // Convert the image back to RGBA color space
-    cv::cvtColor(*rgb_image, *adjusted_image, cv::COLOR_BGR2BGRA);
 
-    parameters_changed = false;
+bool Image::RunPipeline(const std::shared_ptr<cv::UMat>& rgb_image, const cv::Rect& image_region,
+                        const CancellationToken& cancellation_token) {
+    // rgb_image holds only the pixels of image_region. The layers work in its own coordinates, while the
+    // layer cache is keyed by image coordinates so that outputs can be reused for overlapping regions.
+    std::vector<PipelineStep> steps = BuildPipelineSteps();
+    cv::Rect region(0, 0, rgb_image->cols, rgb_image->rows);
 
-    last_adjustment_time = std::chrono::system_clock::now();
+    if (steps.empty()) {
+        return false;
+    }
 
-    return image_changed;
+    // The cache key of a step covers the execution mode and every step up to and including it
+    std::vector<LayerOutputCache::Key> step_keys;
+    LayerOutputCache::Key key = {static_cast<float>(execution_mode)};
+
+    for (const auto& step : steps) {
+        key.insert(key.end(), step.key.begin(), step.key.end());
+        step_keys.push_back(key);
+    }
+
+    // Restart from the first step whose inputs have changed
+    size_t step_index = layer_cache->Resume(step_keys, image_region, *rgb_image);
+
+    while (step_index < steps.size()) {
+        if (cancellation_token.IsCancelled()) {
+            return false;
+        }
+
+        if (!steps[step_index].apply_tile) {
+            steps[step_index].apply(rgb_image, region);
+            layer_cache->Store(step_keys[step_index], image_region, rgb_image->clone());
+            ++step_index;
+            continue;
+        }
+
+        // Run consecutive tile-parallel steps back to back on each tile while it is still in cache.
+        // A step that has to measure the whole region first starts a new pass.
+        size_t end_step = step_index + 1;
+
+        while (end_step < steps.size() && steps[end_step].apply_tile && !steps[end_step].prepare) {
+            ++end_step;
+        }
+
+        if (!RunTilePass(steps, step_index, end_step, step_keys, rgb_image, image_region, cancellation_token)) {
+            return false;
+        }
+
+        step_index = end_step;
+    }
+
+    return true;
+}
+
+
+bool Image::RunTilePass(const std::vector<PipelineStep>& steps, size_t first_step, size_t end_step,
+                        const std::vector<LayerOutputCache::Key>& step_keys,
+                        const std::shared_ptr<cv::UMat>& rgb_image, const cv::Rect& image_region,
+                        const CancellationToken& cancellation_token) {
+    cv::Rect region(0, 0, rgb_image->cols, rgb_image->rows);
+
+    if (steps[first_step].prepare) {
+        steps[first_step].prepare(rgb_image, region);
+    }
+
+    // The output of every step is kept for the layer cache, so each tile is copied out after each step
+    std::vector<cv::UMat> step_outputs(end_step - first_step);
+
+    {
+        // The mapped Mats must be released before the UMats are used again
+        cv::Mat rgb_mat = rgb_image->getMat(cv::ACCESS_RW);
+        std::vector<cv::Mat> step_output_mats;
+
+        for (auto& step_output : step_outputs) {
+            step_output.create(region.size(), rgb_image->type());
+            step_output_mats.push_back(step_output.getMat(cv::ACCESS_WRITE));
+        }
+
+        TiledExecutor::Run(region, [&](const cv::Rect& tile) {
+            // Remaining tiles are skipped once cancelled
+            if (cancellation_token.IsCancelled()) {
+                return;
+            }
+
+            for (size_t i = first_step; i < end_step; ++i) {
+                steps[i].apply_tile(rgb_mat, tile);
+                rgb_mat(tile).copyTo(step_output_mats[i - first_step](tile));
+            }
+        });
+    }
+
+    // Incomplete outputs must not end up in the cache
+    if (cancellation_token.IsCancelled()) {
+        return false;
+    }
+
+    for (size_t i = first_step; i < end_step; ++i) {
+        layer_cache->Store(step_keys[i], image_region, step_outputs[i - first_step]);
+    }
+
+    return true;
+}
+
+
+std::shared_ptr<ColorLookupTable3D> Image::GetLookupTable(unsigned int stages) {
+    auto& lookup_table = lookup_tables[stages];
+
+    if (lookup_table == nullptr) {
+        lookup_table = std::make_shared<ColorLookupTable3D>();
+        lookup_table->Bake(*fused_kernel, stages);
+    }
+
+    return lookup_table;
+}
+
+
+Image::RegionStatistics Image::GetRegionStatistics() {
+    std::lock_guard<std::mutex> lock(processing_mutex);
+
+    float width = static_cast<float>(GetWidth());
+
+    RegionStatistics statistics;
+    statistics.white_balance_gains = white_balance_adjustments_layer->GetGains();
+    statistics.shadow_distance_range = shadow_adjustments_layer->GetDistanceRange() / width;
+    statistics.highlight_distance_range = highlight_adjustments_layer->GetDistanceRange() / width;
+    return statistics;
+}
+
+
+void Image::SetReferenceStatistics(const std::optional<RegionStatistics>& statistics) {
+    std::lock_guard<std::mutex> lock(processing_mutex);
+
+    if (!statistics) {
+        white_balance_adjustments_layer->SetReferenceGains(std::nullopt);
+        shadow_adjustments_layer->SetReferenceDistanceRange(std::nullopt);
+        highlight_adjustments_layer->SetReferenceDistanceRange(std::nullopt);
+        return;
+    }
+
+    float width = static_cast<float>(GetWidth());
+
+    white_balance_adjustments_layer->SetReferenceGains(statistics->white_balance_gains);
+    shadow_adjustments_layer->SetReferenceDistanceRange(statistics->shadow_distance_range * width);
+    highlight_adjustments_layer->SetReferenceDistanceRange(statistics->highlight_distance_range * width);
+}
+
+
+bool Image::HasRegionStatistics(const AdjustmentsParameters& parameters) {
+    return parameters.GetWhiteBalanceSaturationThreshold() != LayerWhiteBalance::DEFAULT_SATURATION_THRESHOLD ||
+           parameters.GetShadow() != LayerShadow::DEFAULT_SHADOW ||
+           parameters.GetHighlight() != LayerHighlight::DEFAULT_HIGHLIGHT;
+}
+
+
+std::shared_ptr<ColorLookupTable3D> Image::BakeLookupTable(const AdjustmentsParameters& parameters) {
+    // Same conditions as in BuildPipelineSteps, these layers need statistics or neighbourhoods
+    if (HasRegionStatistics(parameters)) {
+        return nullptr;
+    }
+
+    FusedPointwiseKernel kernel;
+    kernel.SetParameters(parameters);
+
+    auto lookup_table = std::make_shared<ColorLookupTable3D>();
+    lookup_table->Bake(kernel, kernel.GetActiveStages());
+    return lookup_table;
 }
 
 
 void Image::UpdateImageInfo() {
     image_info.clear();
 
-    image_info.insert(std::make_pair("Width", std::to_string(adjusted_image->cols) + " px"));
-    image_info.insert(std::make_pair("Height", std::to_string(adjusted_image->rows) + " px"));
-    image_info.insert(std::make_pair("Channels", std::to_string(adjusted_image->channels())));
-    image_info.insert(std::make_pair("Number of Pixels", std::to_string(adjusted_image->total()) + " px"));
-    image_info.insert(std::make_pair("Size", std::to_string(adjusted_image->total() * adjusted_image->elemSize()) + " b"));
+    int type = GetType();
+    size_t pixel_count = static_cast<size_t>(GetWidth()) * GetHeight();
+
+    image_info.insert(std::make_pair("Width", std::to_string(GetWidth()) + " px"));
+    image_info.insert(std::make_pair("Height", std::to_string(GetHeight()) + " px"));
+    image_info.insert(std::make_pair("Channels", std::to_string(CV_MAT_CN(type))));
+    image_info.insert(std::make_pair("Number of Pixels", std::to_string(pixel_count) + " px"));
+    image_info.insert(std::make_pair("Size", std::to_string(pixel_count * CV_ELEM_SIZE(type)) + " b"));
 }
 
 
 std::shared_ptr<Image> Image::Clone() const {
-    auto original_image_copy = std::make_shared<cv::UMat>(original_image->clone());
-    auto adjusted_image_copy = std::make_shared<cv::UMat>(adjusted_image->clone());
+    // The clone shares the pixel buffers. Original buffers are never written, and the tiles of the adjusted buffer
+    // are copied by the first image that writes them. Waits for a running pipeline: AdjustParameters changes the
+    // parameters under the same lock, and the pixels taken below then belong to the copied parameters.
+    std::lock_guard<std::mutex> lock(processing_mutex);
 
-    auto cloned_image = std::make_shared<Image>(original_image_copy);
+    auto cloned_image = CloneOriginal();
+    cloned_image->SetExecutionMode(execution_mode);
     cloned_image->AdjustParameters(parameters);
-    cloned_image->adjusted_image = adjusted_image_copy; // instead of cloned_image->ApplyAdjustments() to avoid recalculating the adjustments
+
+    // instead of cloned_image->ApplyAdjustments() to avoid recalculating the adjustments
+    cloned_image->SetMemoryCategory(MemoryBudget::Category::PREVIEW, false, false);
+
+    std::lock_guard<std::mutex> buffer_lock(buffer_mutex);
+    cloned_image->adjusted_pixels = adjusted_pixels;
+
+    // The tiles are shared now and no longer count for this image
+    MemoryBudget::GetInstance().Update(memory_handle, GetMemoryUsage());
     return cloned_image;
 }
+
+
+std::shared_ptr<Image> Image::CloneOriginal() const {
+    if (original_store) {
+        return std::make_shared<Image>(original_store);
+    }
+
+    if (!original_image) {
+        return std::make_shared<Image>(original_size, original_type, original_source);
+    }
+
+    return std::make_shared<Image>(std::make_shared<cv::UMat>(*original_image));
+}
+
+
+cv::UMat Image::ReadAdjusted(const cv::Rect& region) const {
+    std::lock_guard<std::mutex> buffer_lock(buffer_mutex);
+    return adjusted_pixels.Read(region);
+}
+
+
+std::shared_ptr<cv::UMat> Image::GetAdjustedImage() const {
+    std::lock_guard<std::mutex> buffer_lock(buffer_mutex);
+    auto adjusted_image = std::make_shared<cv::UMat>(adjusted_pixels.GetContiguous());
+
+    // Gathering copied tiles makes them private
+    MemoryBudget::GetInstance().Update(memory_handle, GetMemoryUsage());
+    return adjusted_image;
+}
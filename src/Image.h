@@ -3,6 +3,9 @@
 
 #include <string>
 #include <map>
+#include <functional>
+#include <mutex>
+#include <optional>
 
 #ifdef __APPLE__
 #include <OpenGL/gl.h>
@@ -21,39 +24,135 @@
 #include "LayerShadow.h"
 #include "LayerHighlight.h"
 #include "LayerCmyk.h"
+#include "FusedPointwiseKernel.h"
+#include "ColorLookupTable3D.h"
+#include "LayerOutputCache.h"
+#include "TiledExecutor.h"
+#include "CancellationToken.h"
+#include "PixelBuffer.h"
+#include "CompressedTileStore.h"
+#include "MemoryBudget.h"
 
 
 class Image {
 public:
+    // Measured by layers over the whole processed region. Distances are relative to the image width, so that the
+    // statistics of one level apply to all of them.
+    struct RegionStatistics {
+        cv::Vec2f white_balance_gains = cv::Vec2f(1.0f, 1.0f);
+        cv::Vec2f shadow_distance_range = cv::Vec2f(0.0f, 0.0f);
+        cv::Vec2f highlight_distance_range = cv::Vec2f(0.0f, 0.0f);
+    };
+
+    enum class ExecutionMode {
+        LAYERED,    // Run every layer on its own, one full pass per layer
+        FUSED,      // Run consecutive point-wise layers in a single pass with FusedPointwiseKernel
+        LUT,        // Like FUSED, but bake the point-wise layers into a 3D lookup table first (faster, approximate)
+    };
+
     Image(const std::shared_ptr<cv::UMat>& in_image);
+    explicit Image(const std::shared_ptr<CompressedTileStore>& in_store);
+    // The original is read region by region from the source, e.g. a scratch file whose pages belong to the OS
+    Image(const cv::Size& size, int type, PixelBuffer::TileSource in_source);
     ~Image();
 
-    int GetWidth() const { return adjusted_image->cols; }
-    int GetHeight() const { return adjusted_image->rows; }
+    int GetWidth() const { return original_image ? original_image->cols : original_size.width; }
+    int GetHeight() const { return original_image ? original_image->rows : original_size.height; }
+    int GetType() const { return original_image ? original_image->type() : original_type; }
 
     std::unordered_map<std::string, std::string> GetImageInfo() const { return image_info; }
 
     void AdjustParameters(std::shared_ptr<AdjustmentsParameters> parameters_in);
 
-    virtual bool ApplyAdjustments();
-    virtual bool ApplyAdjustmentsRegion(const cv::Rect& region);
+    // The pipeline checks the token between steps and tiles. A cancelled run leaves the adjusted image unchanged.
+    virtual bool ApplyAdjustments(const CancellationToken& cancellation_token = CancellationToken());
+    virtual bool ApplyAdjustmentsRegion(const cv::Rect& region, const CancellationToken& cancellation_token = CancellationToken());
+
+    // Decompresses the whole image if the original is kept compressed
+    std::shared_ptr<cv::UMat> GetOriginalImage() const;
+    // Only the tiles of the region are decompressed
+    cv::UMat ReadOriginal(const cv::Rect& region) const;
+    std::shared_ptr<cv::UMat> GetAdjustedImage() const;
+    // Only the tiles of the region are copied or decompressed, the adjusted buffer is not gathered
+    cv::UMat ReadAdjusted(const cv::Rect& region) const;
+
+    // Keep the original as compressed tiles, which are decompressed on demand. Meant to be called right after
+    // loading, before other threads use the image.
+    void CompressOriginal();
+    bool IsOriginalCompressed() const { return original_store != nullptr; }
+    // Compressed or read from a source, either way only the regions in use are in memory
+    bool IsOriginalStreamed() const { return original_image == nullptr; }
+
+    // Of the last processed region
+    RegionStatistics GetRegionStatistics();
+    // Used instead of measuring every processed region, e.g. when a region is processed in strips. The statistics
+    // have to be measured with the same parameters.
+    void SetReferenceStatistics(const std::optional<RegionStatistics>& statistics);
+    // Some of the adjustments depend on statistics of the processed region
+    static bool HasRegionStatistics(const AdjustmentsParameters& parameters);
+
+    // All adjustments baked into one table, e.g. to apply them on the GPU. Null if any adjustment is not point-wise.
+    static std::shared_ptr<ColorLookupTable3D> BakeLookupTable(const AdjustmentsParameters& parameters);
+
+    void SetExecutionMode(ExecutionMode mode);
+    ExecutionMode GetExecutionMode() const { return execution_mode; }
+
+    // Shares the pixel buffers with the clone, see PixelBuffer
+    std::shared_ptr<Image> Clone() const;
 
-    std::shared_ptr<cv::UMat> GetAdjustedImage() const { return adjusted_image; }
+    // A new image that shares the original, compressed or not, and has no adjustments applied
+    std::shared_ptr<Image> CloneOriginal() const;
 
-    std::shared_ptr<Image> Clone() const;
+    // Images register as full resolution images. Owners that keep images for other purposes, like preview LODs,
+    // change the category. Clones share the original and do not count it.
+    void SetMemoryCategory(MemoryBudget::Category category, bool evictable = false, bool counts_original = true);
+    MemoryBudget::Handle GetMemoryHandle() const { return memory_handle; }
+
+    LayerOutputCache::Statistics GetLayerCacheStatistics() const { return layer_cache->GetStatistics(); }
 
     std::chrono::time_point<std::chrono::system_clock> GetLastAdjustmentTime() const { return last_adjustment_time; }
 
 protected:
+    void CreateLayers();
     virtual void UpdateImageInfo();
+    PixelBuffer::TileSource GetOriginalTileSource() const;
+    static PixelBuffer::TileSource GetStoreTileSource(const std::shared_ptr<CompressedTileStore>& store);
+
+    // One step of the adjustment pipeline: a single layer or a run of fused point-wise layers.
+    // A step either works on the whole region (apply) or is tile-parallel (apply_tile). Tile-parallel steps
+    // may measure the whole region first (prepare), which ends the preceding tile pass.
+    struct PipelineStep {
+        std::vector<float> key; // Pipeline position and parameters of the layers in this step
+        std::function<bool(const std::shared_ptr<cv::UMat>&, const cv::Rect&)> apply;
+        std::function<void(const std::shared_ptr<cv::UMat>&, const cv::Rect&)> prepare;
+        std::function<void(cv::Mat&, const cv::Rect&)> apply_tile;
+    };
+
+    std::vector<PipelineStep> BuildPipelineSteps();
+    bool RunPipeline(const std::shared_ptr<cv::UMat>& rgb_image, const cv::Rect& image_region,
+                     const CancellationToken& cancellation_token);
+    bool RunTilePass(const std::vector<PipelineStep>& steps, size_t first_step, size_t end_step,
+                     const std::vector<LayerOutputCache::Key>& step_keys,
+                     const std::shared_ptr<cv::UMat>& rgb_image, const cv::Rect& image_region,
+                     const CancellationToken& cancellation_token);
+    std::shared_ptr<ColorLookupTable3D> GetLookupTable(unsigned int stages);
+    size_t GetMemoryUsage() const;
 
 protected:
     std::shared_ptr<cv::UMat> original_image;
-    std::shared_ptr<cv::UMat> adjusted_image;
+    std::shared_ptr<CompressedTileStore> original_store;    // Replaces the original image once compressed
+    PixelBuffer::TileSource original_source;    // Reads the original when it is not in memory
+    cv::Size original_size;
+    int original_type = 0;
+    PixelBuffer adjusted_pixels;        // Copy-on-write, shares its tiles with clones and the original image
+    mutable std::mutex buffer_mutex;    // Guards the adjusted pixels
+    MemoryBudget::Handle memory_handle;
+    bool counts_original;               // False if the original belongs to another image
     std::unordered_map<std::string, std::string> image_info;
 
     std::shared_ptr<AdjustmentsParameters> parameters;
     bool parameters_changed;
+    mutable std::mutex processing_mutex; // One pipeline run at a time, parameters only change in between
 
     std::shared_ptr<LayerBrightnessContrast> brightness_contrast_adjustments_layer;
     std::shared_ptr<LayerHueSaturationValue> hsv_adjustments_layer;
@@ -64,6 +163,11 @@ protected:
     std::shared_ptr<LayerHighlight> highlight_adjustments_layer;
     std::shared_ptr<LayerCmyk> cmyk_adjustments_layer;
 
+    ExecutionMode execution_mode;
+    std::shared_ptr<FusedPointwiseKernel> fused_kernel;
+    std::map<unsigned int, std::shared_ptr<ColorLookupTable3D>> lookup_tables; // Baked tables per stage mask
+    std::shared_ptr<LayerOutputCache> layer_cache;
+
     // adjustment timestamp
     std::chrono::time_point<std::chrono::system_clock> last_adjustment_time;
 };
@@ -15,7 +15,13 @@ bool ImageApplyAdjustmentsTask::Execute() {
     std::cout << "Running image adjustments task for image with size "
               << image->GetWidth() << "x" << image->GetHeight()
               << std::endl;
-    bool ok = image->ApplyAdjustments();
+    bool ok = image->ApplyAdjustments(cancellation_token);
+
+    if (cancellation_token.IsCancelled()) {
+        std::cout << "Image adjustments task cancelled" << std::endl;
+        return false;
+    }
+
     std::cout << "Image adjustments task completed" << std::endl;
     return ok;
 }
\ No newline at end of file
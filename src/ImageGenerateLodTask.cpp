@@ -0,0 +1,16 @@
+#include "ImageGenerateLodTask.h"
+
+
+ImageGenerateLodTask::ImageGenerateLodTask(GenerateFunction my_generate_lod) :
+        generate_lod(std::move(my_generate_lod)) {
+}
+
+
+bool ImageGenerateLodTask::Execute() {
+    if (is_cancelled) {
+        return false;
+    }
+
+    lod_image = generate_lod();
+    return lod_image != nullptr;
+}
@@ -0,0 +1,28 @@
+#ifndef POTOPOTO_IMAGEGENERATELODTASK_H
+#define POTOPOTO_IMAGEGENERATELODTASK_H
+
+#include <opencv2/opencv.hpp>
+#include "BackgroundTask.h"
+#include "Image.h"
+
+
+// Builds a LOD image in the background. The generated image can be taken once the task has completed.
+class ImageGenerateLodTask : public BackgroundTask<bool> {
+public:
+    using GenerateFunction = std::function<std::shared_ptr<Image>()>;
+
+    ImageGenerateLodTask(GenerateFunction generate_lod);
+
+    // Hands the generated image over, the task does not keep a reference to it
+    std::shared_ptr<Image> TakeLodImage() { return std::move(lod_image); }
+
+private:
+    bool Execute() override;
+
+private:
+    GenerateFunction generate_lod;
+    std::shared_ptr<Image> lod_image;
+};
+
+
+#endif //POTOPOTO_IMAGEGENERATELODTASK_H
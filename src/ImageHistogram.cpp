@@ -3,16 +3,18 @@
 
 
 ImageHistogram::ImageHistogram(const std::shared_ptr<cv::UMat>& in_image) : Image(in_image) {
-    original_image = std::make_shared<cv::UMat>(in_image->clone());
+    // Resized straight from the input, the histogram never holds a full resolution copy
+    original_image = std::make_shared<cv::UMat>();
 
     // If width is larger than height, then resize by width. Otherwise, resize by height.
-    if (original_image->cols > original_image->rows) {
-        ImageUtils::ResizeImageByHeight(*original_image, *original_image, 100);
+    if (in_image->cols > in_image->rows) {
+        ImageUtils::ResizeImageByHeight(*in_image, *original_image, 100);
     } else {
-        ImageUtils::ResizeImageByWidth(*original_image, *original_image, 100);
+        ImageUtils::ResizeImageByWidth(*in_image, *original_image, 100);
     }
 
-    adjusted_image = std::make_shared<cv::UMat>(original_image->clone());
+    adjusted_pixels = PixelBuffer(*original_image);
+    SetMemoryCategory(MemoryBudget::Category::HISTOGRAM);
 
     UpdateImageInfo();
     UpdateHistogram();
@@ -21,7 +23,6 @@ ImageHistogram::ImageHistogram(const std::shared_ptr<cv::UMat>& in_image) : Imag
 
 ImageHistogram::~ImageHistogram() {
     original_image->release();
-    adjusted_image->release();
 }
 
 
@@ -30,7 +31,7 @@ void ImageHistogram::UpdateHistogram() {
 
     // Separate the image into B, G, R, A planes
     std::vector<cv::Mat> bgr_planes;
-    cv::split(*adjusted_image, bgr_planes);
+    cv::split(*GetAdjustedImage(), bgr_planes);
 
     // Set the number of bins and range
     int histSize = 256;
@@ -57,8 +58,8 @@ void ImageHistogram::UpdateHistogram() {
 }
 
 
-bool ImageHistogram::ApplyAdjustments() {
-    bool image_changed = Image::ApplyAdjustments();
+bool ImageHistogram::ApplyAdjustments(const CancellationToken& cancellation_token) {
+    bool image_changed = Image::ApplyAdjustments(cancellation_token);
     UpdateHistogram();
     return image_changed;
 }
\ No newline at end of file
@@ -10,7 +10,7 @@ public:
 
     std::vector<cv::Mat> GetHistogram() const { return bgr_histogram; }
 
-    bool ApplyAdjustments() override;
+    bool ApplyAdjustments(const CancellationToken& cancellation_token = CancellationToken()) override;
 
 private:
     void UpdateHistogram();
@@ -0,0 +1,23 @@
+#include "ImagePrefetchTask.h"
+
+
+ImagePrefetchTask::ImagePrefetchTask(const std::vector<cv::Rect>& my_tiles, TileFunction my_process_tile) :
+        tiles(my_tiles), process_tile(std::move(my_process_tile)) {
+}
+
+
+bool ImagePrefetchTask::Execute() {
+    int processed_tiles = 0;
+
+    for (const auto& tile : tiles) {
+        if (is_cancelled) {
+            return false;
+        }
+
+        if (process_tile(tile, cancellation_token)) {
+            processed_tiles++;
+        }
+    }
+
+    return processed_tiles > 0;
+}
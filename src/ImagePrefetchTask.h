@@ -0,0 +1,26 @@
+#ifndef POTOPOTO_IMAGEPREFETCHTASK_H
+#define POTOPOTO_IMAGEPREFETCHTASK_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "BackgroundTask.h"
+
+
+// Processes preview tiles around the viewport in order of priority. The task checks for cancellation between tiles,
+// so stopping it waits for one tile at most.
+class ImagePrefetchTask : public BackgroundTask<bool> {
+public:
+    using TileFunction = std::function<bool(const cv::Rect& tile, const CancellationToken& cancellation_token)>;
+
+    ImagePrefetchTask(const std::vector<cv::Rect>& tiles, TileFunction process_tile);
+
+private:
+    bool Execute() override;
+
+private:
+    std::vector<cv::Rect> tiles;
+    TileFunction process_tile;
+};
+
+
+#endif //POTOPOTO_IMAGEPREFETCHTASK_H
@@ -1,201 +1,989 @@
 #include "ImagePreview.h"
 
 
-const int ImagePreview::TARGET_LOD_LOW_PIXELS = 2000000;
-const int ImagePreview::TARGET_LOD_MEDIUM_PIXELS = 6000000;
-const int ImagePreview::TARGET_LOD_HIGH_PIXELS = 9000000;
-
-
-ImagePreview::ImagePreview() {
+const int ImagePreview::MIN_LOD_SIZE = 256;                 // Longest side of the smallest pyramid level
+const int ImagePreview::BASE_LOD_MAX_PIXELS = 2000000;      // Built on load and always kept
+const int ImagePreview::MAX_REFINED_LOD_PIXELS = 9000000;   // Larger levels are only processed region by region
+const size_t ImagePreview::MAX_VALID_REGIONS = 256; // Enough for the viewport and a prefetch ring of tiles
+const int ImagePreview::PREFETCH_TILE_SIZE = 256;
+const int ImagePreview::DEFAULT_PREFETCH_RING_TILES = 2;
+const float ImagePreview::PAN_DIRECTION_WEIGHT = 0.75f; // 0 ignores the pan direction, 1 defers tiles behind it
+const std::chrono::seconds ImagePreview::LOD_EVICTION_IDLE_TIME = std::chrono::seconds(60);
+const int64_t ImagePreview::SPILL_MIN_PIXELS = 200000000;  // Smaller images rebuild evicted levels quickly enough
+const int ImagePreview::LOD_STRIP_ROWS = 1024;              // Rows of a compressed original decompressed at once
+
+
+ImagePreview::ImagePreview() : lod_tasks_generation(0), lod_images_generation(0), prefetch_ring_tiles(DEFAULT_PREFETCH_RING_TILES) {
     Reset();
 }
 
 
 ImagePreview::~ImagePreview() {
+    StopPrefetch();
+    RetireLodTasks();
+    RetireLodGenerationTasks();
+    retired_tasks.clear(); // Joins the remaining task threads
 }
 
 
 void ImagePreview::LoadImage(const std::shared_ptr<Image> &in_image) {
     GenerateLodImages(in_image);
-    SetLodLevel(LodLevel::LOW);
+    SetLodLevel(base_lod_level);
 }
 
 
 void ImagePreview::Reset() {
+    StopPrefetch();
+    RetireLodTasks();
+    RetireLodGenerationTasks();
+
+    std::unique_lock<std::shared_mutex> lod_lock(lodImageMutex);
+    std::lock_guard<std::mutex> lock(partialImageMutex);
+    std::lock_guard<std::mutex> display_lock(displayMutex);
+
     lod_images.clear();
+    lod_last_used.clear();
+    source_image.reset();
+    spill_cache.reset();
     partial_lod_image.reset();
-    current_lod_level = LodLevel::LOW;
+    displayed_partial_image.reset();
+    pending_lod_image.reset();
+    statistics_image.reset();
+    statistics_parameters.reset();
+    region_statistics.reset();
+    valid_regions.clear();
+    display_dirty_regions.clear();
+    outdated_lods = 0;
+    current_lod_level = 0;
+    requested_lod_level = 0;
+    base_lod_level = 0;
     lod_sizes.clear();
     parameters = std::make_shared<AdjustmentsParameters>();
-    apply_adjustments_tasks.clear();
     completedTasks = 0;
 }
 
 
 void ImagePreview::GenerateLodImages(const std::shared_ptr<Image>& in_image) {
+    StopPrefetch();
+    RetireLodGenerationTasks();
+
+    std::unique_lock<std::shared_mutex> lod_lock(lodImageMutex);
+
     lod_images.clear();
     lod_sizes.clear();
+    lod_last_used.clear();
+
+    // Level 0 is the full resolution image, every further level halves it until the thumbnail size is reached
+    source_image = in_image;
+    cv::Size size(in_image->GetWidth(), in_image->GetHeight());
+    base_lod_level = 0;
+
+    for (LodLevel lod_level = 0; lod_level < MAX_LOD_LEVELS; lod_level++) {
+        lod_sizes.insert({lod_level, size});
+
+        if (size.area() > BASE_LOD_MAX_PIXELS) {
+            base_lod_level = lod_level + 1;
+        }
+
+        if (std::max(size.width, size.height) <= MIN_LOD_SIZE) {
+            break;
+        }
+
+        size = cv::Size((size.width + 1) / 2, (size.height + 1) / 2);
+    }
+
+    base_lod_level = std::min(base_lod_level, GetLodCount() - 1);
+
+    // Levels of very large images are spilled to a scratch file when they are evicted. It has room for all levels
+    // but the full resolution one, which is never spilled.
+    spill_cache.reset();
+
+    if (static_cast<int64_t>(in_image->GetWidth()) * in_image->GetHeight() >= SPILL_MIN_PIXELS) {
+        size_t spill_bytes = 0;
 
-    std::shared_ptr<Image> lod_low = GenerateLodImage(in_image, LodLevel::LOW);
-    lod_images.insert({LodLevel::LOW, lod_low});
-    lod_sizes.insert({LodLevel::LOW, lod_low->GetAdjustedImage()->size()});
+        for (const auto& [lod_level, lod_size] : lod_sizes) {
+            if (lod_level > 0) {
+                // Edge tiles take a whole slot
+                int tiles_x = (lod_size.width + MappedTileCache::DEFAULT_TILE_SIZE - 1) / MappedTileCache::DEFAULT_TILE_SIZE;
+                int tiles_y = (lod_size.height + MappedTileCache::DEFAULT_TILE_SIZE - 1) / MappedTileCache::DEFAULT_TILE_SIZE;
+                spill_bytes += static_cast<size_t>(tiles_x) * tiles_y * MappedTileCache::DEFAULT_TILE_SIZE *
+                               MappedTileCache::DEFAULT_TILE_SIZE * CV_ELEM_SIZE(in_image->GetType());
+            }
+        }
+
+        spill_cache = std::make_shared<MappedTileCache>(in_image->GetType(), spill_bytes);
+
+        if (!spill_cache->IsOpen()) {
+            spill_cache.reset();
+        }
+    }
 
-    std::shared_ptr<Image> lod_medium = GenerateLodImage(in_image, LodLevel::MEDIUM);
-    lod_images.insert({LodLevel::MEDIUM, lod_medium});
-    lod_sizes.insert({LodLevel::MEDIUM, lod_medium->GetAdjustedImage()->size()});
+    // Only the sizes are known up front. The base level is built right away, the others when they are first displayed.
+    std::cout << "Generating LOD image for level " << base_lod_level << std::endl;
 
-    std::shared_ptr<Image> lod_high = GenerateLodImage(in_image, LodLevel::HIGH);
-    lod_images.insert({LodLevel::HIGH, lod_high});
-    lod_sizes.insert({LodLevel::HIGH, lod_high->GetAdjustedImage()->size()});
+    auto lod_base = GenerateLodImage(source_image, lod_sizes.at(base_lod_level));
+    lod_base->SetMemoryCategory(MemoryBudget::Category::LOD, false, base_lod_level != 0);
+    lod_base->AdjustParameters(parameters);
+    lod_images.insert({base_lod_level, lod_base});
+    current_lod_level = base_lod_level;
+    requested_lod_level = base_lod_level;
+
+    std::lock_guard<std::mutex> lock(partialImageMutex);
 
     partial_lod_image = lod_images.at(current_lod_level)->Clone();
-}
+    partial_lod_image->SetExecutionMode(Image::ExecutionMode::LUT); // Interactive preview trades accuracy for speed
+    statistics_image = GenerateLodImage(lod_base, lod_sizes.rbegin()->second);
+    statistics_parameters.reset();
+    region_statistics.reset();
+    valid_regions.clear();
+
+    {
+        std::lock_guard<std::mutex> display_lock(displayMutex);
+        pending_lod_image.reset();
+        display_dirty_regions.clear();
+    }
 
+    MarkDisplayDirty(current_lod_level);
+    PublishPartialImage();
+}
 
-std::shared_ptr<Image> ImagePreview::GenerateLodImage(const std::shared_ptr<Image>& in_image, LodLevel lod_level) {
-    std::cout << "Generating LOD image for level " << static_cast<int>(lod_level) << std::endl;
-    auto image_copy = in_image->Clone();
 
-    int target_px = 0;
+std::shared_ptr<Image> ImagePreview::GenerateLodImage(const std::shared_ptr<Image>& source, const cv::Size& size) {
+    // Full resolution shares the original, which stays compressed if it is
+    if (cv::Size(source->GetWidth(), source->GetHeight()) == size) {
+        return source->CloneOriginal();
+    }
 
-    switch (lod_level) {
-        case LodLevel::LOW:
-            target_px = TARGET_LOD_LOW_PIXELS;
-            break;
-        case LodLevel::MEDIUM:
-            target_px = TARGET_LOD_MEDIUM_PIXELS;
-            break;
-        case LodLevel::HIGH:
-            target_px = TARGET_LOD_HIGH_PIXELS;
-            break;
-        default:
-            target_px = TARGET_LOD_HIGH_PIXELS;
+    if (source->IsOriginalStreamed()) {
+        return std::make_shared<Image>(ResizeImageLodInStrips(source, size));
     }
 
-    auto cv_lod_image = ResizeImageLod(image_copy->GetAdjustedImage(), target_px);
+    return std::make_shared<Image>(ResizeImageLod(source->GetOriginalImage(), size));
+}
+
 
-    auto lod_image = std::make_shared<Image>(cv_lod_image);
-    lod_image->AdjustParameters(parameters);
-    return lod_image;
+ImagePreview::LodLevel ImagePreview::GetLodLevelForScale(float scale) const {
+    if (lod_sizes.empty() || scale <= 0.0f) {
+        return base_lod_level;
+    }
+
+    // The finest level that has at least one image pixel per screen pixel. Rounding gives a little headroom, so
+    // that a level is not left for the next finer one at the first sign of magnification.
+    auto lod_level = static_cast<LodLevel>(std::floor(std::log2(1.0f / scale) + 0.25f));
+    return std::clamp(lod_level, 0, GetLodCount() - 1);
 }
 
 
-std::shared_ptr<cv::UMat> ImagePreview::ResizeImageLod(const std::shared_ptr<cv::UMat>& in_image, int target_px) {
-    auto out_image = std::make_shared<cv::UMat>(in_image->clone());
+std::shared_ptr<cv::UMat> ImagePreview::ResizeImageLod(const std::shared_ptr<cv::UMat>& in_image, const cv::Size& size) {
+    // Already the right size. Original buffers are never written, so the new header can share the pixels.
+    if (in_image->size() == size) {
+        return std::make_shared<cv::UMat>(*in_image);
+    }
+
+    // Area averaging is the right filter for downsampling and much cheaper than Lanczos. cv::resize splits the
+    // output rows across its own worker threads.
+    auto out_image = std::make_shared<cv::UMat>();
+    cv::resize(*in_image, *out_image, size, 0, 0, cv::INTER_AREA);
+
+    std::cout << "Image resized for preview to " << out_image->cols << "x" << out_image->rows << std::endl;
+
+    return out_image;
+}
+
 
-    // Calculate the total number of pixels in the original image
-    int res = in_image->cols * in_image->rows;
+std::shared_ptr<cv::UMat> ImagePreview::ResizeImageLodInStrips(const std::shared_ptr<Image>& in_image, const cv::Size& size) {
+    // Decompressing the whole original would take the memory the compression saves. A strip of rows is
+    // decompressed at a time and resized into its share of the output rows.
+    auto out_image = std::make_shared<cv::UMat>(size, in_image->GetType());
+    int width = in_image->GetWidth();
+    int height = in_image->GetHeight();
+    double scale_y = static_cast<double>(size.height) / height;
 
-    // Calculate the correct resize factor for linear dimensions
-    float resize_factor = std::sqrt((float) target_px / (float) res);
+    for (int y = 0; y < height; y += LOD_STRIP_ROWS) {
+        int strip_height = std::min(LOD_STRIP_ROWS, height - y);
+        int out_y = cvRound(y * scale_y);
+        int out_end_y = cvRound((y + strip_height) * scale_y);
 
-    // Resize the image if the factor is less than 1 (i.e., target size is smaller than the original size)
-    if (resize_factor < 1) {
-        auto new_width = static_cast<int>(std::ceil(in_image->cols * resize_factor));
-        ResizeImageByWidth(*in_image, *out_image, new_width);
+        // Strips that round to no output rows are covered by their neighbours
+        if (out_end_y <= out_y) {
+            continue;
+        }
 
-        std::cout << "Image resized for preview to " << out_image->cols << "x" << out_image->rows
-                  << " with factor " << resize_factor << std::endl;
+        cv::UMat strip = in_image->ReadOriginal(cv::Rect(0, y, width, strip_height));
+        cv::UMat out_strip = (*out_image)(cv::Rect(0, out_y, size.width, out_end_y - out_y));
+        cv::resize(strip, out_strip, out_strip.size(), 0, 0, cv::INTER_AREA);
     }
 
+    std::cout << "Image resized in strips for preview to " << size.width << "x" << size.height << std::endl;
+
     return out_image;
 }
 
 
 void ImagePreview::AdjustParameters(std::shared_ptr<AdjustmentsParameters> parameters_in) {
-    parameters = parameters_in;
-    lod_images.at(LodLevel::LOW)->AdjustParameters(parameters);
-    lod_images.at(LodLevel::MEDIUM)->AdjustParameters(parameters);
-    lod_images.at(LodLevel::HIGH)->AdjustParameters(parameters);
-    partial_lod_image->AdjustParameters(parameters);
+    {
+        // Same parameters again, e.g. when a slider is released. Keep the valid regions and running tasks.
+        std::lock_guard<std::mutex> lock(partialImageMutex);
+
+        if (parameters_in == parameters) {
+            return;
+        }
+    }
+
+    // Results of running tasks would be outdated. Cancelling does not wait, and the images below
+    // only wait for the running tile or layer to notice the cancellation.
+    StopPrefetch();
+    RetireLodTasks();
+
+    std::vector<std::shared_ptr<Image>> adjusted_lods;
+
+    {
+        std::shared_lock<std::shared_mutex> lod_lock(lodImageMutex);
+        std::lock_guard<std::mutex> lock(partialImageMutex);
+
+        {
+            // Levels built from now on pick up the new parameters themselves
+            std::lock_guard<std::mutex> display_lock(displayMutex);
+            parameters = parameters_in;
+        }
+
+        for (const auto& lod_image : lod_images) {
+            adjusted_lods.push_back(lod_image.second);
+        }
+
+        SwitchPartialImage();
+
+        // Only processed under partialImageMutex, so this never waits for a pipeline
+        partial_lod_image->AdjustParameters(parameters);
+
+        // Nothing of the partial image is valid for the new parameters
+        valid_regions.clear();
+        outdated_lods = ~0u;
+    }
+
+    // A level waits for its retired task to notice the cancellation. The preview locks are released by then,
+    // so painting and switching levels on the UI thread do not stall behind it.
+    for (const auto& lod_image : adjusted_lods) {
+        lod_image->AdjustParameters(parameters_in);
+    }
 }
 
 
 bool ImagePreview::ApplyAdjustmentsForPreviewRegion(const cv::Rect& region) {
-    return partial_lod_image->ApplyAdjustmentsRegion(region);
+    // Once the displayed LOD image has caught up with the parameters, it is shown instead of the partial image
+    if (!IsLodOutdated(current_lod_level)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(partialImageMutex);
+    SwitchPartialImage();
+
+    cv::Size size(partial_lod_image->GetWidth(), partial_lod_image->GetHeight());
+    cv::Rect clamped_region = region & cv::Rect(0, 0, size.width, size.height);
+
+    // After a pan only the newly exposed strips need processing
+    std::vector<cv::Rect> dirty_regions = SubtractRegions(clamped_region, valid_regions);
+
+    if (dirty_regions.empty()) {
+        return false;
+    }
+
+    UpdateRegionStatistics();
+
+    for (const auto& dirty_region : dirty_regions) {
+        partial_lod_image->ApplyAdjustmentsRegion(dirty_region);
+        AddDisplayDirtyRegion(current_lod_level, dirty_region);
+    }
+
+    AddValidRegion(clamped_region);
+    PublishPartialImage();
+    return true;
+}
+
+
+void ImagePreview::PrefetchAroundRegion(const cv::Rect& visible_region, const cv::Point2f& pan_velocity,
+                                        float zoom_rate, std::function<void()> prefetchCallback) {
+    StopPrefetch();
+
+    // Zooming in only shows parts of the current viewport, which are already processed
+    if (!IsLodOutdated(current_lod_level) || prefetch_ring_tiles <= 0 || zoom_rate > 1.0f) {
+        return;
+    }
+
+    std::vector<cv::Rect> known_valid_regions;
+
+    {
+        // Called on the UI thread, which does not wait for the partial image. While it is being processed the
+        // ring is not filtered, the worker skips tiles that are valid by then anyway.
+        std::unique_lock<std::mutex> lock(partialImageMutex, std::try_to_lock);
+
+        if (lock.owns_lock()) {
+            std::lock_guard<std::mutex> display_lock(displayMutex);
+
+            // The valid regions still belong to the previous level while a level switch is pending
+            if (!pending_lod_image) {
+                known_valid_regions = valid_regions;
+            }
+        }
+    }
+
+    std::vector<cv::Rect> tiles = GetPrefetchTiles(visible_region, pan_velocity, known_valid_regions);
+
+    if (tiles.empty()) {
+        return;
+    }
+
+    auto tiles_processed = std::make_shared<std::atomic<bool>>(false);
+
+    std::lock_guard<std::mutex> lock(taskMutex);
+
+    // Another thread may have started a prefetch meanwhile
+    if (prefetch_task) {
+        RetireTask(prefetch_task);
+    }
+
+    prefetch_task = std::make_shared<ImagePrefetchTask>(tiles, [this, tiles_processed](const cv::Rect& tile,
+                                                                                      const CancellationToken& cancellation_token) {
+        bool processed = ApplyAdjustmentsForPrefetchTile(tile, cancellation_token);
+        *tiles_processed = *tiles_processed || processed;
+        return processed;
+    });
+
+    // Speculative work yields to everything the user is waiting for
+    prefetch_task->Run([tiles_processed, prefetchCallback](TaskStatus status) {
+        if (status == TaskStatus::SUCCESS && *tiles_processed && prefetchCallback) {
+            prefetchCallback();
+        }
+    }, ThreadPool::Priority::LOW);
+}
+
+
+void ImagePreview::StopPrefetch() {
+    std::lock_guard<std::mutex> lock(taskMutex);
+
+    if (prefetch_task) {
+        RetireTask(prefetch_task);
+        prefetch_task.reset();
+    }
+
+    PruneRetiredTasks();
+}
+
+
+bool ImagePreview::ApplyAdjustmentsForPrefetchTile(const cv::Rect& tile, const CancellationToken& cancellation_token) {
+    std::lock_guard<std::mutex> lock(partialImageMutex);
+    SwitchPartialImage();
+
+    std::vector<cv::Rect> dirty_regions = SubtractRegions(tile, valid_regions);
+
+    if (!dirty_regions.empty()) {
+        UpdateRegionStatistics();
+    }
+
+    for (const auto& dirty_region : dirty_regions) {
+        partial_lod_image->ApplyAdjustmentsRegion(dirty_region, cancellation_token);
+    }
+
+    // A cancelled tile is left unprocessed, possibly for parameters that have changed meanwhile
+    if (cancellation_token.IsCancelled()) {
+        return false;
+    }
+
+    AddValidRegion(tile);
+
+    for (const auto& dirty_region : dirty_regions) {
+        AddDisplayDirtyRegion(current_lod_level, dirty_region);
+    }
+
+    PublishPartialImage();
+
+    return !dirty_regions.empty();
 }
 
 
-void ImagePreview::ApplyAdjustmentsForAllLodsAsync(std::function<void()> successCallback) {
-    std::unique_lock<std::shared_mutex> lock(lodImageMutex);
+// Expects taskMutex to be held by the caller, like PruneRetiredTasks
+void ImagePreview::RetireTask(const std::shared_ptr<BackgroundTask<bool>>& task) {
+    task->Stop();
+    retired_tasks.push_back(task);
+}
+
+
+void ImagePreview::RetireLodTasks() {
+    std::lock_guard<std::mutex> lock(taskMutex);
+
+    lod_tasks_generation++;
 
     for (auto& task : apply_adjustments_tasks) {
-        task.second->Stop();
+        RetireTask(task.second);
     }
 
     apply_adjustments_tasks.clear();
+    PruneRetiredTasks();
+}
+
+
+void ImagePreview::PruneRetiredTasks() {
+    // Only finished tasks are released, joining their threads returns immediately
+    retired_tasks.erase(std::remove_if(retired_tasks.begin(), retired_tasks.end(), [](const auto& task) {
+        return !task->IsRunning();
+    }), retired_tasks.end());
+}
+
+
+std::vector<cv::Rect> ImagePreview::GetPrefetchTiles(const cv::Rect& visible_region, const cv::Point2f& pan_velocity,
+                                                     const std::vector<cv::Rect>& skipped_regions) const {
+    cv::Size size = lod_sizes.at(current_lod_level);
+    cv::Rect image_bounds(0, 0, size.width, size.height);
+    int ring = prefetch_ring_tiles * PREFETCH_TILE_SIZE;
+
+    // Tiles are aligned to a fixed grid so that rings of successive viewports share tiles
+    int first_x = std::max(0, (visible_region.x - ring) / PREFETCH_TILE_SIZE * PREFETCH_TILE_SIZE);
+    int first_y = std::max(0, (visible_region.y - ring) / PREFETCH_TILE_SIZE * PREFETCH_TILE_SIZE);
+    int last_x = std::min(size.width, visible_region.br().x + ring);
+    int last_y = std::min(size.height, visible_region.br().y + ring);
+
+    cv::Point2f viewport_center(visible_region.x + visible_region.width * 0.5f, visible_region.y + visible_region.height * 0.5f);
+    float speed = std::sqrt(pan_velocity.dot(pan_velocity));
+
+    std::vector<std::pair<float, cv::Rect>> scored_tiles;
+
+    for (int y = first_y; y < last_y; y += PREFETCH_TILE_SIZE) {
+        for (int x = first_x; x < last_x; x += PREFETCH_TILE_SIZE) {
+            cv::Rect tile = cv::Rect(x, y, PREFETCH_TILE_SIZE, PREFETCH_TILE_SIZE) & image_bounds;
+
+            // Skip tiles that are empty, inside the viewport or already valid
+            if (tile.empty() || (tile & visible_region) == tile || SubtractRegions(tile, skipped_regions).empty()) {
+                continue;
+            }
+
+            cv::Point2f tile_center(tile.x + tile.width * 0.5f, tile.y + tile.height * 0.5f);
+
+            // Distance of the tile from the viewport, 0 for tiles touching it
+            float distance_x = std::max({0.0f, visible_region.x - tile_center.x, tile_center.x - visible_region.br().x});
+            float distance_y = std::max({0.0f, visible_region.y - tile_center.y, tile_center.y - visible_region.br().y});
+            float score = std::max(distance_x, distance_y) + PREFETCH_TILE_SIZE;
+
+            // Tiles ahead of the pan direction come first
+            cv::Point2f offset = tile_center - viewport_center;
+            float offset_length = std::sqrt(offset.dot(offset));
+
+            if (speed > 0.0f && offset_length > 0.0f) {
+                float alignment = offset.dot(pan_velocity) / (offset_length * speed);
+                score *= 1.0f - PAN_DIRECTION_WEIGHT * alignment;
+            }
+
+            scored_tiles.emplace_back(score, tile);
+        }
+    }
+
+    std::stable_sort(scored_tiles.begin(), scored_tiles.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+
+    std::vector<cv::Rect> tiles;
+
+    for (const auto& scored_tile : scored_tiles) {
+        tiles.push_back(scored_tile.second);
+    }
+
+    return tiles;
+}
+
+
+void ImagePreview::UpdateRegionStatistics() {
+    // Expects partialImageMutex to be held. Each region of the partial image would otherwise measure its own white
+    // balance gains and shadow and highlight ranges, which shows as seams between the strips of a pan.
+    if (statistics_parameters != parameters) {
+        statistics_parameters = parameters;
+        region_statistics.reset();
+
+        // Measured once per parameter set, on the smallest level to keep it short
+        if (parameters && statistics_image && Image::HasRegionStatistics(*parameters)) {
+            auto measured_image = statistics_image->CloneOriginal();
+            measured_image->SetExecutionMode(partial_lod_image->GetExecutionMode());
+            measured_image->AdjustParameters(parameters);
+            measured_image->ApplyAdjustments();
+            region_statistics = measured_image->GetRegionStatistics();
+        }
+    }
+
+    // The partial image is replaced when the level changes
+    partial_lod_image->SetReferenceStatistics(region_statistics);
+}
+
+
+void ImagePreview::AddValidRegion(const cv::Rect& region) {
+    // Regions contained in the new one are redundant
+    valid_regions.erase(std::remove_if(valid_regions.begin(), valid_regions.end(), [&region](const cv::Rect& valid_region) {
+        return (valid_region & region) == valid_region;
+    }), valid_regions.end());
+
+    valid_regions.push_back(region);
+
+    // Forgetting the oldest regions only means that they are processed again
+    if (valid_regions.size() > MAX_VALID_REGIONS) {
+        valid_regions.erase(valid_regions.begin());
+    }
+}
+
+
+void ImagePreview::AddDisplayDirtyRegion(LodLevel lod_level, const cv::Rect& region) {
+    std::lock_guard<std::mutex> display_lock(displayMutex);
+
+    // A single bounding rectangle, so that the canvas uploads it in one piece
+    cv::Rect& dirty_region = display_dirty_regions[lod_level];
+    dirty_region = dirty_region.empty() ? region : (dirty_region | region);
+}
+
+
+void ImagePreview::MarkDisplayDirty(LodLevel lod_level) {
+    std::lock_guard<std::mutex> display_lock(displayMutex);
+
+    cv::Size size = lod_sizes.at(lod_level);
+    display_dirty_regions[lod_level] = cv::Rect(0, 0, size.width, size.height);
+}
+
+
+// Expects partialImageMutex to be held by the caller, the adjustment time is written while processing
+void ImagePreview::PublishPartialImage() {
+    std::lock_guard<std::mutex> display_lock(displayMutex);
+
+    // The partial image belongs to the previous level while a level switch is pending
+    if (pending_lod_image) {
+        return;
+    }
+
+    displayed_partial_image = partial_lod_image;
+    displayed_partial_time = partial_lod_image->GetLastAdjustmentTime();
+}
+
+
+// Expects partialImageMutex to be held by the caller. Takes over the level SetLodLevel has switched to, if any.
+void ImagePreview::SwitchPartialImage() {
+    std::shared_ptr<Image> lod_image;
+
+    {
+        std::lock_guard<std::mutex> display_lock(displayMutex);
+        lod_image.swap(pending_lod_image);
+    }
+
+    if (!lod_image) {
+        return;
+    }
+
+    partial_lod_image = lod_image->Clone();
+    partial_lod_image->SetExecutionMode(Image::ExecutionMode::LUT);
+
+    // The level may not have caught up with the parameters yet, AdjustParameters updates the levels after it has
+    // released the locks. The clone would then keep the stale parameters.
+    partial_lod_image->AdjustParameters(parameters);
+    valid_regions.clear();
+}
+
+
+std::vector<cv::Rect> ImagePreview::SubtractRegions(const cv::Rect& region, const std::vector<cv::Rect>& subtracted_regions) {
+    std::vector<cv::Rect> remaining_regions;
+
+    if (!region.empty()) {
+        remaining_regions.push_back(region);
+    }
+
+    for (const auto& subtracted_region : subtracted_regions) {
+        std::vector<cv::Rect> next_regions;
+
+        for (const auto& remaining_region : remaining_regions) {
+            cv::Rect overlap = remaining_region & subtracted_region;
+
+            if (overlap.empty()) {
+                next_regions.push_back(remaining_region);
+                continue;
+            }
+
+            // Split what is left into up to four strips around the overlap
+            cv::Point top_left = remaining_region.tl();
+            cv::Point bottom_right = remaining_region.br();
+
+            if (overlap.y > top_left.y) {
+                next_regions.emplace_back(top_left.x, top_left.y, remaining_region.width, overlap.y - top_left.y);
+            }
+
+            if (overlap.br().y < bottom_right.y) {
+                next_regions.emplace_back(top_left.x, overlap.br().y, remaining_region.width, bottom_right.y - overlap.br().y);
+            }
+
+            if (overlap.x > top_left.x) {
+                next_regions.emplace_back(top_left.x, overlap.y, overlap.x - top_left.x, overlap.height);
+            }
+
+            if (overlap.br().x < bottom_right.x) {
+                next_regions.emplace_back(overlap.br().x, overlap.y, bottom_right.x - overlap.br().x, overlap.height);
+            }
+        }
+
+        remaining_regions = next_regions;
+    }
+
+    return remaining_regions;
+}
+
+
+void ImagePreview::ApplyAdjustmentsForAllLodsAsync(std::function<void(LodLevel)> lodCallback) {
+    // Tasks of a previous release are abandoned without waiting for them
+    RetireLodTasks();
+    EvictLods();
+
+    {
+        // Once per slider release rather than per tick, the counts cover the whole drag
+        std::lock_guard<std::mutex> lock(partialImageMutex);
+
+        if (partial_lod_image) {
+            auto cache_statistics = partial_lod_image->GetLayerCacheStatistics();
+            std::cout << "Layer cache: " << cache_statistics.hits << " hits, " << cache_statistics.misses << " misses, "
+                      << cache_statistics.entries << " entries, " << cache_statistics.bytes / (1024 * 1024) << " of "
+                      << cache_statistics.max_bytes / (1024 * 1024) << " MB" << std::endl;
+        }
+    }
+
+    std::lock_guard<std::mutex> task_lock(taskMutex);
+    std::shared_lock<std::shared_mutex> lod_lock(lodImageMutex);
+
+    // The displayed LOD goes first and gets the cores, the others are refined in the background. Levels too large
+    // to refine as a whole are only processed where they are displayed, through the partial image.
+    std::vector<LodLevel> lod_levels;
+
+    if (lod_images.count(current_lod_level) > 0 && IsLodRefinable(current_lod_level)) {
+        lod_levels.push_back(current_lod_level);
+    }
+
+    for (const auto& lod_image : lod_images) {
+        if (lod_image.first != current_lod_level && IsLodRefinable(lod_image.first)) {
+            lod_levels.push_back(lod_image.first);
+        }
+    }
 
     completedTasks = 0;
-    const int totalTasks = 3;  // LOW, MEDIUM, HIGH
+    const int totalTasks = static_cast<int>(lod_levels.size());
+    unsigned int generation = lod_tasks_generation;
 
-    auto onTaskCompleted = [this, totalTasks, successCallback]() {
+    auto onTaskCompleted = [this, generation, totalTasks, lodCallback](LodLevel lod_level) {
         std::unique_lock<std::shared_mutex> lock(lodImageMutex);
 
+        // A task that completed right before it was retired
+        if (generation != lod_tasks_generation) {
+            return;
+        }
+
         completedTasks++;
-        if (completedTasks == totalTasks && successCallback) {
-            successCallback();
+        outdated_lods &= ~(1u << lod_level);
+
+        // The LOD image is displayed instead of the partial image from now on
+        MarkDisplayDirty(lod_level);
+
+        if (completedTasks == totalTasks) {
+            std::cout << "All refined LOD images are up to date" << std::endl;
+        }
+
+        // Each LOD is published as soon as it is done, so the displayed one does not wait for the others
+        if (lodCallback) {
+            lodCallback(lod_level);
         }
     };
 
-    auto lod_low_task = std::make_shared<ImageApplyAdjustmentsTask>(lod_images.at(LodLevel::LOW), std::chrono::seconds(600));
-    apply_adjustments_tasks.insert({LodLevel::LOW, lod_low_task});
-    lod_low_task->Run([this, onTaskCompleted](TaskStatus status) {
-        if (status == TaskStatus::SUCCESS) {
-            onTaskCompleted();
+    for (LodLevel lod_level : lod_levels) {
+        auto priority = lod_level == current_lod_level ? ThreadPool::Priority::HIGH : ThreadPool::Priority::LOW;
+
+        auto lod_task = std::make_shared<ImageApplyAdjustmentsTask>(lod_images.at(lod_level), std::chrono::seconds(600));
+        apply_adjustments_tasks.insert({lod_level, lod_task});
+        lod_task->Run([onTaskCompleted, lod_level](TaskStatus status) {
+            if (status == TaskStatus::SUCCESS) {
+                onTaskCompleted(lod_level);
+            }
+        }, priority);
+    }
+}
+
+
+bool ImagePreview::SetLodLevel(ImagePreview::LodLevel lod_level, std::function<void()> lodReadyCallback) {
+    // Set first, so that eviction keeps the level while it is built and until it is displayed
+    requested_lod_level = lod_level;
+    EvictLods();
+
+    {
+        std::shared_lock<std::shared_mutex> lod_lock(lodImageMutex);
+
+        if (lod_images.count(lod_level) == 0) {
+            // The current LOD stays on screen until the requested one has been built
+            lod_lock.unlock();
+            GenerateLodImageAsync(lod_level, lodReadyCallback);
+            return false;
         }
-    });
+    }
+
+    StopPrefetch();
+
+    // Unique, the level and the use times are read under the shared lock, e.g. by GetFrame. Held briefly, like in
+    // EvictLods.
+    std::unique_lock<std::shared_mutex> lod_lock(lodImageMutex);
+
+    auto now = std::chrono::steady_clock::now();
+    lod_last_used[current_lod_level] = now;
+    lod_last_used[lod_level] = now;
 
-    auto lod_medium_task = std::make_shared<ImageApplyAdjustmentsTask>(lod_images.at(LodLevel::MEDIUM), std::chrono::seconds(600));
-    apply_adjustments_tasks.insert({LodLevel::MEDIUM, lod_medium_task});
-    lod_medium_task->Run([this, onTaskCompleted](TaskStatus status) {
-        if (status == TaskStatus::SUCCESS) {
-            onTaskCompleted();
+    auto lod_image = lod_images.at(lod_level);
+    MemoryBudget::GetInstance().Touch(lod_image->GetMemoryHandle());
+
+    {
+        // Processing holds partialImageMutex for as long as a region takes, so the switch is only handed over here.
+        // The processing threads clone the partial image of the level, see SwitchPartialImage.
+        std::lock_guard<std::mutex> display_lock(displayMutex);
+        current_lod_level = lod_level;
+        pending_lod_image = lod_image;
+
+        // The level itself is shown until its partial image has been processed
+        displayed_partial_image.reset();
+    }
+
+    // The texture of the level may still show what it showed when the level was last displayed
+    MarkDisplayDirty(lod_level);
+    return true;
+}
+
+
+void ImagePreview::GenerateLodImageAsync(LodLevel lod_level, std::function<void()> lodReadyCallback) {
+    std::lock_guard<std::mutex> task_lock(taskMutex);
+
+    auto running_task = lod_generation_tasks.find(lod_level);
+    if (running_task != lod_generation_tasks.end()) {
+        if (running_task->second->IsRunning()) {
+            return;
         }
-    });
 
-    auto lod_high_task = std::make_shared<ImageApplyAdjustmentsTask>(lod_images.at(LodLevel::HIGH), std::chrono::seconds(600));
-    apply_adjustments_tasks.insert({LodLevel::HIGH, lod_high_task});
-    lod_high_task->Run([this, onTaskCompleted](TaskStatus status) {
-        if (status == TaskStatus::SUCCESS) {
-            onTaskCompleted();
+        RetireTask(running_task->second);
+        lod_generation_tasks.erase(running_task);
+    }
+
+    std::shared_ptr<Image> source;
+    cv::Size size;
+    {
+        std::shared_lock<std::shared_mutex> lod_lock(lodImageMutex);
+
+        if (!source_image) {
+            return;
+        }
+
+        // Cascade from the smallest built LOD that is still larger than the requested one
+        source = source_image;
+        size = lod_sizes.at(lod_level);
+
+        for (LodLevel larger_level = lod_level - 1; larger_level > 0; larger_level--) {
+            if (lod_images.count(larger_level) > 0) {
+                source = lod_images.at(larger_level);
+                break;
+            }
+        }
+    }
+
+    std::cout << "Generating LOD image for level " << lod_level << " in the background" << std::endl;
+
+    unsigned int generation = lod_images_generation;
+    std::shared_ptr<MappedTileCache> spill = spill_cache;
+    auto generate_task = std::make_shared<ImageGenerateLodTask>([source, size, spill, lod_level]() {
+        // A spilled level is read through the mapping, the OS pages in the tiles that are displayed or processed
+        cv::Size spilled_size;
+        PixelBuffer::TileSource spilled_source = spill ? spill->GetSource(lod_level, spilled_size) : nullptr;
+
+        if (spilled_source && spilled_size == size) {
+            return std::make_shared<Image>(size, source->GetType(), spilled_source);
         }
+
+        return GenerateLodImage(source, size);
     });
+    std::weak_ptr<ImageGenerateLodTask> weak_task = generate_task;
+
+    lod_generation_tasks.insert({lod_level, generate_task});
+    generate_task->Run([this, weak_task, lod_level, generation, lodReadyCallback](TaskStatus status) {
+        auto task = weak_task.lock();
+
+        if (status != TaskStatus::SUCCESS || !task) {
+            return;
+        }
+
+        {
+            std::unique_lock<std::shared_mutex> lod_lock(lodImageMutex);
+
+            // Built for an image that has been closed in the meantime
+            if (generation != lod_images_generation) {
+                return;
+            }
+
+            // Only reads the parameters
+            std::lock_guard<std::mutex> display_lock(displayMutex);
+
+            // Level 0 shares the pixels of the full resolution image
+            auto lod_image = task->TakeLodImage();
+            lod_image->SetMemoryCategory(MemoryBudget::Category::LOD, true, lod_level != 0);
+            lod_image->AdjustParameters(parameters);
+            lod_images.insert({lod_level, lod_image});
+            lod_last_used[lod_level] = std::chrono::steady_clock::now();
+            outdated_lods |= 1u << lod_level;
+        }
+
+        // The new level may have pushed the preview over the memory budget
+        EvictLods();
+
+        if (lodReadyCallback) {
+            lodReadyCallback();
+        }
+    }, ThreadPool::Priority::HIGH);
+}
+
+
+void ImagePreview::RetireLodGenerationTasks() {
+    std::lock_guard<std::mutex> lock(taskMutex);
+
+    lod_images_generation++;
+
+    for (auto& task : lod_generation_tasks) {
+        RetireTask(task.second);
+    }
+
+    lod_generation_tasks.clear();
+    PruneRetiredTasks();
 }
 
 
-void ImagePreview::SetLodLevel(ImagePreview::LodLevel lod_level) {
-    current_lod_level = lod_level;
-    partial_lod_image = lod_images.at(lod_level)->Clone();
+void ImagePreview::EvictLods() {
+    auto now = std::chrono::steady_clock::now();
+    MemoryBudget& memory_budget = MemoryBudget::GetInstance();
+
+    std::vector<std::pair<LodLevel, std::shared_ptr<Image>>> spilled_lods;
+    std::shared_ptr<MappedTileCache> spill;
+
+    std::unique_lock<std::shared_mutex> lod_lock(lodImageMutex);
+    spill = spill_cache;
+
+    for (auto lod_image = lod_images.begin(); lod_image != lod_images.end();) {
+        LodLevel lod_level = lod_image->first;
+
+        // The base level is always kept, it is what is shown while another level is built. A requested level that
+        // has just been built would otherwise be evicted and built again in a loop under memory pressure.
+        if (lod_level == base_lod_level || lod_level == current_lod_level || lod_level == requested_lod_level) {
+            ++lod_image;
+            continue;
+        }
+
+        // Levels that have been idle for a while, and the coldest buffers under memory pressure
+        bool idle = now - lod_last_used[lod_level] >= LOD_EVICTION_IDLE_TIME;
+
+        if (!idle && !memory_budget.ShouldEvict(lod_image->second->GetMemoryHandle())) {
+            ++lod_image;
+            continue;
+        }
+
+        // Built again, or read back from the scratch file, the next time it is displayed. Level 0 shares the
+        // original and is never spilled.
+        std::cout << "Evicting " << (idle ? "idle" : "cold") << " LOD image for level " << lod_level << std::endl;
+
+        if (spill && lod_level > 0 && !spill->Contains(lod_level)) {
+            spilled_lods.emplace_back(lod_level, lod_image->second);
+        }
+
+        lod_image = lod_images.erase(lod_image);
+    }
+
+    lod_lock.unlock();
+
+    // Written in the background, copying a level and starting its write-back takes too long for the UI thread.
+    // The pixels of a level never change once it is built.
+    for (const auto& [lod_level, lod_image] : spilled_lods) {
+        ThreadPool::GetInstance().Submit([spill, lod_level = lod_level, lod_image = lod_image]() {
+            if (spill->Store(lod_level, lod_image->GetOriginalImage()->getMat(cv::ACCESS_READ))) {
+                std::cout << "Spilled LOD image for level " << lod_level << ", "
+                          << spill->GetStoredBytes() / (1024 * 1024) << " MB in the scratch file" << std::endl;
+            }
+        }, ThreadPool::Priority::LOW);
+    }
 }
 
 
-cv::Mat ImagePreview::GetImage() {
+ImagePreview::Frame ImagePreview::GetFrame(const cv::Rect& clip_region) {
     std::shared_lock<std::shared_mutex> lock(lodImageMutex);
 
-    std::cout << "Getting image for LOD level " << static_cast<int>(current_lod_level) << std::endl;
+    Frame frame;
+    frame.lod_level = current_lod_level;
+    frame.size = lod_sizes.at(current_lod_level);
 
-    auto lod_image = lod_images.at(current_lod_level);
-    if (lod_image->GetLastAdjustmentTime() >= partial_lod_image->GetLastAdjustmentTime()) {
-        std::cout << "Returning full LOD image." << std::endl;
-        return lod_image->GetAdjustedImage()->getMat(cv::ACCESS_READ);
-    } else if (partial_lod_image) {
-        std::cout << "Returning partial LOD image." << std::endl;
-        return partial_lod_image->GetAdjustedImage()->getMat(cv::ACCESS_READ);
-    } else {
-        std::cerr << "No image available!" << std::endl;
-        return cv::Mat();  // Return an empty image
+    std::shared_ptr<Image> displayed_image;
+
+    {
+        std::lock_guard<std::mutex> display_lock(displayMutex);
+        frame.parameters = parameters;
+
+        cv::Rect& dirty_region = display_dirty_regions[current_lod_level];
+        frame.changed_region = dirty_region;
+        frame.region = clip_region.empty() ? dirty_region : (dirty_region & clip_region);
+        dirty_region = cv::Rect();
+
+        if (frame.region.empty()) {
+            return frame;
+        }
+
+        displayed_image = GetDisplayedImage();
     }
+
+    // Only the tiles of the region are read, a compressed full resolution level stays compressed. The partial
+    // image may be processed meanwhile, its buffer is only locked while a finished region is written back.
+    frame.buffer = std::make_shared<cv::UMat>(displayed_image->ReadAdjusted(frame.region));
+    frame.pixels = frame.buffer->getMat(cv::ACCESS_READ);
+    return frame;
 }
 
 
-void ImagePreview::ResizeImageByWidth(const cv::UMat& inputImage, cv::UMat& outputImage, int newWidth) {
-    // Get the original dimensions
-    int originalWidth = inputImage.cols;
-    int originalHeight = inputImage.rows;
+ImagePreview::Frame ImagePreview::GetRegion(const cv::Rect& region, bool original) {
+    std::shared_lock<std::shared_mutex> lock(lodImageMutex);
+
+    Frame frame;
+    frame.lod_level = current_lod_level;
+    frame.size = lod_sizes.at(current_lod_level);
+    frame.region = region & cv::Rect(0, 0, frame.size.width, frame.size.height);
+    frame.changed_region = frame.region;
+
+    std::shared_ptr<Image> displayed_image;
 
-    // Calculate the new height to maintain aspect ratio
-    int newHeight = static_cast<int>(newWidth * (static_cast<float>(originalHeight) / originalWidth));
+    {
+        std::lock_guard<std::mutex> display_lock(displayMutex);
+        frame.parameters = parameters;
+        displayed_image = GetDisplayedImage();
+    }
+
+    if (frame.region.empty()) {
+        return frame;
+    }
+
+    if (original) {
+        // Only the tiles of the region are decompressed if the level shares a compressed original
+        frame.buffer = std::make_shared<cv::UMat>(lod_images.at(current_lod_level)->ReadOriginal(frame.region));
+        frame.pixels = frame.buffer->getMat(cv::ACCESS_READ);
+        return frame;
+    }
+
+    // Called once per texture tile. Reading only the tile keeps the copy-on-write tiles shared and never copies
+    // the whole level on the UI thread.
+    frame.buffer = std::make_shared<cv::UMat>(displayed_image->ReadAdjusted(frame.region));
+    frame.pixels = frame.buffer->getMat(cv::ACCESS_READ);
+    return frame;
+}
+
+
+// Expects lodImageMutex and displayMutex to be held by the caller
+std::shared_ptr<Image> ImagePreview::GetDisplayedImage() {
+    auto lod_image = lod_images.at(current_lod_level);
+    MemoryBudget::GetInstance().Touch(lod_image->GetMemoryHandle());
+
+    // Once the LOD image has caught up with the parameters it is shown instead of the partial image
+    if (!displayed_partial_image || lod_image->GetLastAdjustmentTime() >= displayed_partial_time) {
+        return lod_image;
+    }
 
-    // Use Lanczos interpolation for high-quality resizing
-    cv::resize(inputImage, outputImage, cv::Size(newWidth, newHeight), 0, 0, cv::INTER_LANCZOS4);
+    return displayed_partial_image;
 }
@@ -2,21 +2,34 @@
 #define POTOPOTO_IMAGEPREVIEW_H
 
 #include <map>
+#include <optional>
 #include <OpenGL/gl.h>
 #include <opencv2/opencv.hpp>
 #include <shared_mutex>
 
 #include "Image.h"
 #include "ImageApplyAdjustmentsTask.h"
+#include "ImagePrefetchTask.h"
+#include "ImageGenerateLodTask.h"
 #include "AdjustmentsParameters.h"
+#include "MappedTileCache.h"
 
 
 class ImagePreview {
 public:
-    enum class LodLevel {
-        LOW,
-        MEDIUM,
-        HIGH,
+    // Level of the image pyramid. Level 0 is the full resolution image, every further level halves its size.
+    using LodLevel = int;
+
+    // Pixels of the displayed LOD that changed since the previous frame was taken
+    struct Frame {
+        LodLevel lod_level = 0;
+        cv::Size size;          // Size of the whole LOD image
+        cv::Rect region;        // Region of the pixels, empty if nothing changed
+        cv::Rect changed_region;    // Everything that changed, pixels outside of the region have to be read again
+        std::shared_ptr<cv::UMat> buffer;   // Keeps the pixels alive, the image may drop its buffers meanwhile
+        cv::Mat pixels;         // Pixels of the region, they keep changing unless copied
+        int upload_buffer = -1; // Mapped buffer the pixels have been copied into, see UploadBufferPool
+        std::shared_ptr<AdjustmentsParameters> parameters;  // Parameters the preview is processed with
     };
 
     ImagePreview();
@@ -26,40 +39,122 @@ public:
     void Reset();
 
     void AdjustParameters(std::shared_ptr<AdjustmentsParameters> parameters_in);
+    // Processes only the parts of the region that are not valid for the current parameters yet.
+    // Returns true if any part of the partial image was updated.
     bool ApplyAdjustmentsForPreviewRegion(const cv::Rect& region);
-    void ApplyAdjustmentsForAllLodsAsync(std::function<void()> successCallback);
-
-    void SetLodLevel(LodLevel lod_level);
+    // The displayed LOD is processed first with high priority. The callback is called from a worker thread
+    // for every LOD as soon as it is done.
+    void ApplyAdjustmentsForAllLodsAsync(std::function<void(LodLevel)> lodCallback);
+
+    // Processes a ring of tiles around the visible region in the background. Tiles ahead of the pan direction
+    // come first. The ring is dropped as soon as the parameters, the LOD level or the viewport change.
+    // The callback is called from the worker thread after tiles have been processed.
+    void PrefetchAroundRegion(const cv::Rect& visible_region, const cv::Point2f& pan_velocity, float zoom_rate,
+                              std::function<void()> prefetchCallback);
+    void StopPrefetch();
+    void SetPrefetchRingTiles(int ring_tiles) { prefetch_ring_tiles = ring_tiles; }
+
+    // Switches to the LOD level and returns true if it has been built already. Otherwise the current LOD stays
+    // on screen, the level is built in the background and the callback is called from the worker thread
+    // when it is ready. Levels other than the base level are built on first use and evicted again when they
+    // stay unused.
+    bool SetLodLevel(LodLevel lod_level, std::function<void()> lodReadyCallback = nullptr);
+    LodLevel GetLodLevel() const { return current_lod_level; }
+    // Level for a scale of screen pixels per full resolution pixel
+    LodLevel GetLodLevelForScale(float scale) const;
+    int GetLodCount() const { return static_cast<int>(lod_sizes.size()); }
     std::map<LodLevel, cv::Size> GetLodSizes() const { return lod_sizes; }
 
-    cv::Mat GetImage();
+    // Takes the region of the displayed LOD that changed since the previous frame. Only the pixels inside of the
+    // clip region are returned, if one is given. Every change is handed out once, so there should be a single
+    // consumer that keeps the previous frames.
+    Frame GetFrame(const cv::Rect& clip_region = cv::Rect());
+    // Current pixels of a region of the displayed LOD, without taking any changes. The original pixels are the
+    // unadjusted ones.
+    Frame GetRegion(const cv::Rect& region, bool original = false);
     cv::Size GetSize() const { return lod_sizes.at(current_lod_level); }
     cv::Size GetSize(LodLevel lodLevel) const { return lod_sizes.at(lodLevel); }
+    cv::Size GetFullSize() const { return lod_sizes.at(0); }
 
     std::shared_mutex& GetLodImageMutex() { return lodImageMutex; }
 
 private:
     void GenerateLodImages(const std::shared_ptr<Image>& in_image);
-    std::shared_ptr<Image> GenerateLodImage(const std::shared_ptr<Image>& in_image, LodLevel lod_level);
-    std::shared_ptr<cv::UMat> ResizeImageLod(const std::shared_ptr<cv::UMat>& in_image, int target_px);
-    void ResizeImageByWidth(const cv::UMat& inputImage, cv::UMat& outputImage, int newWidth);
+    static std::shared_ptr<Image> GenerateLodImage(const std::shared_ptr<Image>& source, const cv::Size& size);
+    void GenerateLodImageAsync(LodLevel lod_level, std::function<void()> lodReadyCallback);
+    void RetireLodGenerationTasks();
+    void EvictLods();   // Idle levels, and cold levels while the memory budget is exceeded
+    static std::shared_ptr<cv::UMat> ResizeImageLod(const std::shared_ptr<cv::UMat>& in_image, const cv::Size& size);
+    static std::shared_ptr<cv::UMat> ResizeImageLodInStrips(const std::shared_ptr<Image>& in_image, const cv::Size& size);
+    void UpdateRegionStatistics();
+    void AddValidRegion(const cv::Rect& region);
+    void AddDisplayDirtyRegion(LodLevel lod_level, const cv::Rect& region);
+    void MarkDisplayDirty(LodLevel lod_level);
+    void PublishPartialImage();
+    void SwitchPartialImage();
+    std::shared_ptr<Image> GetDisplayedImage();
+    bool ApplyAdjustmentsForPrefetchTile(const cv::Rect& tile, const CancellationToken& cancellation_token);
+    void RetireTask(const std::shared_ptr<BackgroundTask<bool>>& task);
+    void RetireLodTasks();
+    void PruneRetiredTasks();
+    bool IsLodOutdated(LodLevel lod_level) const { return outdated_lods & (1u << lod_level); }
+    bool IsLodRefinable(LodLevel lod_level) const { return lod_sizes.at(lod_level).area() <= MAX_REFINED_LOD_PIXELS; }
+    std::vector<cv::Rect> GetPrefetchTiles(const cv::Rect& visible_region, const cv::Point2f& pan_velocity,
+                                           const std::vector<cv::Rect>& skipped_regions) const;
+    static std::vector<cv::Rect> SubtractRegions(const cv::Rect& region, const std::vector<cv::Rect>& subtracted_regions);
 
 private:
-    static const int TARGET_LOD_LOW_PIXELS;
-    static const int TARGET_LOD_MEDIUM_PIXELS;
-    static const int TARGET_LOD_HIGH_PIXELS;
-
-    std::map<LodLevel, std::shared_ptr<Image>> lod_images;
+    static constexpr int MAX_LOD_LEVELS = 32; // One bit per level in outdated_lods
+    static const int MIN_LOD_SIZE;
+    static const int BASE_LOD_MAX_PIXELS;
+    static const int MAX_REFINED_LOD_PIXELS;
+    static const size_t MAX_VALID_REGIONS;
+    static const int PREFETCH_TILE_SIZE;
+    static const int DEFAULT_PREFETCH_RING_TILES;
+    static const float PAN_DIRECTION_WEIGHT;
+    static const std::chrono::seconds LOD_EVICTION_IDLE_TIME;
+    static const int64_t SPILL_MIN_PIXELS;
+    static const int LOD_STRIP_ROWS;
+
+    std::map<LodLevel, std::shared_ptr<Image>> lod_images;  // LODs that have been built
     std::shared_mutex lodImageMutex;  // Mutex to protect LOD image access
+    std::shared_ptr<Image> source_image;     // Full resolution image the LODs are built from, may be compressed
+    std::map<LodLevel, std::chrono::steady_clock::time_point> lod_last_used;
+    std::shared_ptr<MappedTileCache> spill_cache;   // Evicted levels of very large images, read back instead of rebuilt
 
     std::shared_ptr<Image> partial_lod_image;
-    LodLevel current_lod_level;
+    std::mutex partialImageMutex;             // Serializes the viewport and the prefetch worker on the partial image
+    std::vector<cv::Rect> valid_regions;      // Regions of the partial image processed with the current parameters
+    std::shared_ptr<Image> statistics_image;  // Smallest level, the region statistics are measured on it
+    std::shared_ptr<AdjustmentsParameters> statistics_parameters;
+    std::optional<Image::RegionStatistics> region_statistics;  // Shared by all regions of the partial image
+
+    // What the UI thread paints from. Published by the processing threads, so painting never waits for them.
+    std::mutex displayMutex;                  // Held only briefly, never while processing
+    std::shared_ptr<Image> displayed_partial_image;
+    std::chrono::time_point<std::chrono::system_clock> displayed_partial_time;  // Of the last published region
+    std::shared_ptr<Image> pending_lod_image; // Level SetLodLevel has switched to, not yet taken over by processing
+    std::map<LodLevel, cv::Rect> display_dirty_regions;    // Changed since the last frame, per level
+    std::atomic<unsigned int> outdated_lods;  // Bit per LOD level that has not caught up with the parameters yet
+    std::atomic<LodLevel> current_lod_level;  // Written under the unique lodImageMutex lock, read by processing without it
+    std::atomic<LodLevel> requested_lod_level;    // Last level passed to SetLodLevel, it may still be built
+    LodLevel base_lod_level;                  // Largest level of at most BASE_LOD_MAX_PIXELS
     std::map<LodLevel, cv::Size> lod_sizes;
-    std::shared_ptr<AdjustmentsParameters> parameters;
+    std::shared_ptr<AdjustmentsParameters> parameters; // Written under partialImageMutex and displayMutex
 
     std::unordered_map<LodLevel, std::shared_ptr<ImageApplyAdjustmentsTask>> apply_adjustments_tasks;
     std::atomic<int> completedTasks;
-    std::mutex taskMutex;
+    std::atomic<unsigned int> lod_tasks_generation; // Completions of retired LOD tasks are ignored
+    std::mutex taskMutex;                     // Protects the LOD, prefetch and retired tasks
+
+    std::map<LodLevel, std::shared_ptr<ImageGenerateLodTask>> lod_generation_tasks;
+    std::atomic<unsigned int> lod_images_generation; // LODs built for a previous image are dropped
+
+    // Cancelled tasks are kept alive until their threads have finished, so cancelling never waits for them
+    std::vector<std::shared_ptr<BackgroundTask<bool>>> retired_tasks;
+
+    std::shared_ptr<ImagePrefetchTask> prefetch_task;
+    int prefetch_ring_tiles;
 };
 
 
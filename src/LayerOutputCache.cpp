@@ -0,0 +1,141 @@
+#include "LayerOutputCache.h"
+#include <iostream>
+
+
+const size_t LayerOutputCache::DEFAULT_MAX_BYTES = 128 * 1024 * 1024;
+
+
+LayerOutputCache::LayerOutputCache(size_t max_bytes) :
+        used_bytes(0),
+        max_bytes(max_bytes),
+        hits(0),
+        misses(0) {
+    memory_handle = MemoryBudget::GetInstance().Register(MemoryBudget::Category::LAYER_CACHE, 0, true);
+}
+
+
+LayerOutputCache::~LayerOutputCache() {
+    MemoryBudget::GetInstance().Unregister(memory_handle);
+}
+
+
+size_t LayerOutputCache::Resume(const std::vector<Key>& step_keys, const cv::Rect& region, cv::UMat& rgb_image) {
+    for (size_t step = step_keys.size(); step > 0; --step) {
+        const Key& key = step_keys[step - 1];
+
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            // The cached output can be reused if it was computed for a region containing the requested one
+            if (it->key != key || (it->region & region) != region) {
+                continue;
+            }
+
+            cv::Rect offset_region(region.x - it->region.x, region.y - it->region.y, region.width, region.height);
+            it->output(offset_region).copyTo(rgb_image);
+
+            entries.splice(entries.begin(), entries, it);
+            MemoryBudget::GetInstance().Touch(memory_handle);
+
+            hits += step;
+            misses += step_keys.size() - step;
+            return step;
+        }
+    }
+
+    misses += step_keys.size();
+    return 0;
+}
+
+
+void LayerOutputCache::Store(const Key& step_key, const cv::Rect& region, const cv::UMat& output) {
+    size_t bytes = region.area() * output.elemSize();
+
+    // Outputs of the same step are only redundant if one region contains the other
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (it->key != step_key) {
+            ++it;
+        } else if ((it->region & region) == region) {
+            entries.splice(entries.begin(), entries, it);
+            MemoryBudget::GetInstance().Touch(memory_handle);
+            return;
+        } else if ((it->region & region) == it->region) {
+            used_bytes -= it->bytes;
+            it = entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (bytes > max_bytes) {
+        UpdateMemoryBudget();
+        return;
+    }
+
+    EvictToFit(bytes);
+
+    Entry entry;
+    entry.key = step_key;
+    entry.region = region;
+    entry.output = output;
+    entry.bytes = bytes;
+
+    entries.push_front(entry);
+    used_bytes += bytes;
+    UpdateMemoryBudget();
+}
+
+
+void LayerOutputCache::Clear() {
+    entries.clear();
+    used_bytes = 0;
+    UpdateMemoryBudget();
+}
+
+
+void LayerOutputCache::SetMaxBytes(size_t bytes) {
+    max_bytes = bytes;
+    EvictToFit(0);
+    UpdateMemoryBudget();
+}
+
+
+LayerOutputCache::Statistics LayerOutputCache::GetStatistics() const {
+    Statistics statistics;
+    statistics.hits = hits;
+    statistics.misses = misses;
+    statistics.entries = entries.size();
+    statistics.bytes = used_bytes;
+    statistics.max_bytes = max_bytes;
+    return statistics;
+}
+
+
+void LayerOutputCache::EvictToFit(size_t bytes) {
+    // Drop the least recently used outputs until the new one fits
+    while (!entries.empty() && used_bytes + bytes > max_bytes) {
+        used_bytes -= entries.back().bytes;
+        entries.pop_back();
+    }
+}
+
+
+void LayerOutputCache::UpdateMemoryBudget() {
+    MemoryBudget& memory_budget = MemoryBudget::GetInstance();
+    memory_budget.Update(memory_handle, used_bytes);
+
+    if (!memory_budget.ShouldEvict(memory_handle)) {
+        return;
+    }
+
+    // Other buffers are hotter, drop the oldest outputs until the budget is met. They are recomputed when needed.
+    size_t excess_bytes = memory_budget.GetExcessBytes();
+    size_t released_bytes = 0;
+
+    while (!entries.empty() && released_bytes < excess_bytes) {
+        released_bytes += entries.back().bytes;
+        used_bytes -= entries.back().bytes;
+        entries.pop_back();
+    }
+
+    std::cout << "Layer cache released " << released_bytes / 1024 << " KB under memory pressure" << std::endl;
+    memory_budget.Update(memory_handle, used_bytes);
+}
@@ -0,0 +1,64 @@
+#ifndef POTOPOTO_LAYEROUTPUTCACHE_H
+#define POTOPOTO_LAYEROUTPUTCACHE_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <list>
+
+#include "MemoryBudget.h"
+
+
+// Caches the output of each pipeline step so that a run can resume after the last step whose inputs did not change.
+// Entries are keyed by the cumulative parameter key of all steps up to and including the cached one, so changing a
+// parameter invalidates its own step and every step after it, but nothing before it.
+class LayerOutputCache {
+public:
+    using Key = std::vector<float>;
+
+    struct Statistics {
+        size_t hits = 0;      // Steps served from the cache
+        size_t misses = 0;    // Steps that had to be recomputed
+        size_t entries = 0;
+        size_t bytes = 0;
+        size_t max_bytes = 0;
+    };
+
+    LayerOutputCache(size_t max_bytes = DEFAULT_MAX_BYTES);
+    ~LayerOutputCache();
+
+    // Find the last step with a cached output covering the region. Copies that part of the output into rgb_image,
+    // which holds the region only, and returns the number of steps that can be skipped (0 if nothing was found).
+    size_t Resume(const std::vector<Key>& step_keys, const cv::Rect& region, cv::UMat& rgb_image);
+
+    // Store the output of a step. The output is the region only and is kept without copying. Outputs of the same
+    // step for other regions are kept too, e.g. the viewport next to the prefetch tiles around it.
+    void Store(const Key& step_key, const cv::Rect& region, const cv::UMat& output);
+    void Clear();
+
+    void SetMaxBytes(size_t bytes);
+    Statistics GetStatistics() const;
+
+    static const size_t DEFAULT_MAX_BYTES;
+
+private:
+    struct Entry {
+        Key key;
+        cv::Rect region;
+        cv::UMat output;
+        size_t bytes;
+    };
+
+    void EvictToFit(size_t bytes);
+    void UpdateMemoryBudget(); // Report the used bytes and give up the oldest outputs under memory pressure
+
+private:
+    std::list<Entry> entries; // Most recently used first
+    size_t used_bytes;
+    size_t max_bytes;
+    size_t hits;
+    size_t misses;
+    MemoryBudget::Handle memory_handle;
+};
+
+
+#endif //POTOPOTO_LAYEROUTPUTCACHE_H
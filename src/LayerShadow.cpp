@@ -6,7 +6,8 @@ const float LayerShadow::DEFAULT_SHADOW = 0.0f;
 
 LayerShadow::LayerShadow() :
         shadow(DEFAULT_SHADOW),
-        values_have_changed(false) {
+        values_have_changed(false),
+        distance_range(0.0f, 0.0f) {
 }
 
 
@@ -50,8 +51,21 @@ bool LayerShadow::Process(const cv::Rect& region) {
     cv::distanceTransform(blurred_shadow_mask, distance_transform, cv::DIST_L2, 5);
 
     // Normalize the distance transform to [0, 1] for softening the mask's edges
-    distance_transform.convertTo(distance_transform, CV_32F);
-    cv::normalize(distance_transform, distance_transform, 0, 1.0, cv::NORM_MINMAX);
+    if (reference_distance_range) {
+        distance_range = *reference_distance_range;
+    } else {
+        double min_distance = 0.0;
+        double max_distance = 0.0;
+        cv::minMaxLoc(distance_transform, &min_distance, &max_distance);
+        distance_range = cv::Vec2f(static_cast<float>(min_distance), static_cast<float>(max_distance));
+    }
+
+    // Maps the range to [0, 1] like NORM_MINMAX. Distances outside of a reference range are clamped.
+    double span = distance_range[1] - distance_range[0];
+    double scale = span > 0.0 ? 1.0 / span : 0.0;
+    distance_transform.convertTo(distance_transform, CV_32F, scale, -distance_range[0] * scale);
+    cv::threshold(distance_transform, distance_transform, 1.0, 1.0, cv::THRESH_TRUNC);
+    cv::threshold(distance_transform, distance_transform, 0.0, 0.0, cv::THRESH_TOZERO);
 
     // Scale the distance transform to a more subtle value (0.005 for less impact)
     cv::multiply(distance_transform, 2, distance_transform); // Adjust the scaling factor as needed
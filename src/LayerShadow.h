@@ -2,6 +2,7 @@
 #define POTOPOTO_LAYERSHADOW_H
 
 #include <opencv2/opencv.hpp>
+#include <optional>
 #include "LayerBase.h"
 
 
@@ -14,6 +15,11 @@ public:
 
     bool ParametersHaveChanged() override { return values_have_changed; }
 
+    // The distances of the mask are normalised to this range in pixels. It is measured over the processed region
+    // unless a reference range is set, e.g. for a region that is processed in strips.
+    void SetReferenceDistanceRange(const std::optional<cv::Vec2f>& range) { reference_distance_range = range; }
+    cv::Vec2f GetDistanceRange() const { return distance_range; }
+
     static const float DEFAULT_SHADOW;
 
 protected:
@@ -23,6 +29,8 @@ protected:
 private:
     float shadow;
     bool values_have_changed;
+    std::optional<cv::Vec2f> reference_distance_range;
+    cv::Vec2f distance_range;   // Of the last processed region
 };
 
 #endif //POTOPOTO_LAYERSHADOW_H
\ No newline at end of file
@@ -5,7 +5,10 @@
 const float LayerWhiteBalance::DEFAULT_SATURATION_THRESHOLD = 0.0f;
 
 
-LayerWhiteBalance::LayerWhiteBalance() : saturation_threshold(DEFAULT_SATURATION_THRESHOLD), values_have_changed(false) {
+LayerWhiteBalance::LayerWhiteBalance() :
+        saturation_threshold(DEFAULT_SATURATION_THRESHOLD),
+        values_have_changed(false),
+        gains(1.0f, 1.0f) {
 }
 
 
@@ -50,7 +53,29 @@ void LayerWhiteBalance::GrayworldWhiteBalance(cv::UMat& src, cv::UMat& dst, floa
 }
 
 
+cv::Vec2f LayerWhiteBalance::MeasureGains(const cv::UMat& src) {
+    gains = reference_gains ? *reference_gains : ComputeGains(src, saturation_threshold);
+    return gains;
+}
+
+
 void LayerWhiteBalance::GpuWhiteBalance(cv::UMat& src, cv::UMat& dst, float threshold) {
+    gains = reference_gains ? *reference_gains : ComputeGains(src, threshold);
+
+    // Split the image into RGB channels
+    std::vector<cv::UMat> channels(3);
+    cv::split(src, channels); // Split into RGB channels
+
+    // Scale the Red and Blue channels based on the calculated factors
+    cv::multiply(channels[2], gains[0], channels[2]); // Adjust Red channel
+    cv::multiply(channels[0], gains[1], channels[0]); // Adjust Blue channel
+
+    // Merge the channels back into the output image (dst)
+    cv::merge(channels, dst);
+}
+
+
+cv::Vec2f LayerWhiteBalance::ComputeGains(const cv::UMat& src, float threshold) {
     // Split the image into RGB channels
     std::vector<cv::UMat> channels(3);
     cv::split(src, channels); // Split into RGB channels
@@ -79,10 +104,18 @@ void LayerWhiteBalance::GpuWhiteBalance(cv::UMat& src, cv::UMat& dst, float thre
     scaleR = std::clamp(scaleR, 0.5f, 2.0f);
     scaleB = std::clamp(scaleB, 0.5f, 2.0f);
 
-    // Scale the Red and Blue channels based on the calculated factors
-    cv::multiply(channels[2], scaleR, channels[2]); // Adjust Red channel
-    cv::multiply(channels[0], scaleB, channels[0]); // Adjust Blue channel
+    return cv::Vec2f(scaleR, scaleB);
+}
 
-    // Merge the channels back into the output image (dst)
-    cv::merge(channels, dst);
-}
\ No newline at end of file
+
+void LayerWhiteBalance::ApplyGains(cv::Mat& rgb_image, const cv::Rect& region, const cv::Vec2f& gains) {
+    // Same channel order and rounding as the cv::multiply calls in GpuWhiteBalance
+    for (int row = region.y; row < region.y + region.height; ++row) {
+        uchar* pixel = rgb_image.ptr<uchar>(row) + region.x * 3;
+
+        for (int col = 0; col < region.width; ++col, pixel += 3) {
+            pixel[2] = cv::saturate_cast<uchar>(pixel[2] * gains[0]);
+            pixel[0] = cv::saturate_cast<uchar>(pixel[0] * gains[1]);
+        }
+    }
+}
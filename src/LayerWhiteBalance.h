@@ -2,6 +2,7 @@
 #define POTOPOTO_LAYERWHITEBALANCE_H
 
 #include <opencv2/opencv.hpp>
+#include <optional>
 #include "LayerBase.h"
 
 
@@ -14,6 +15,17 @@ public:
 
     void SetSaturationThreshold(float in_saturation_threshold);
 
+    // Gains are measured over the processed region unless reference gains are set, e.g. for a region that is
+    // processed in strips. MeasureGains returns the gains to use and keeps them for GetGains.
+    void SetReferenceGains(const std::optional<cv::Vec2f>& gains) { reference_gains = gains; }
+    cv::Vec2f MeasureGains(const cv::UMat& src);
+    cv::Vec2f GetGains() const { return gains; }
+
+    // Split form of Process for tiled execution: the gains are measured over the whole region once
+    // and then applied tile by tile. Gains are (red scale, blue scale).
+    static cv::Vec2f ComputeGains(const cv::UMat& src, float threshold);
+    static void ApplyGains(cv::Mat& rgb_image, const cv::Rect& region, const cv::Vec2f& gains);
+
     static const float DEFAULT_SATURATION_THRESHOLD;
 
 private:
@@ -26,6 +38,8 @@ private:
 private:
     float saturation_threshold;
     bool values_have_changed;
+    std::optional<cv::Vec2f> reference_gains;
+    cv::Vec2f gains;    // Of the last processed region
 };
 
 #endif //POTOPOTO_LAYERWHITEBALANCE_H
\ No newline at end of file
@@ -0,0 +1,285 @@
+#include "MappedTileCache.h"
+#include "TiledExecutor.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+const int MappedTileCache::DEFAULT_TILE_SIZE = 256;
+
+
+MappedTileCache::MappedTileCache(int my_type, size_t capacity_bytes, int my_tile_size) :
+        type(my_type), elem_size(CV_ELEM_SIZE(my_type)), tile_size(my_tile_size), file_descriptor(-1),
+        mapping(nullptr), mapping_bytes(0), use_counter(0) {
+    // A multiple of 64 KB for the default tile size, so every slot starts on a page
+    slot_bytes = static_cast<size_t>(tile_size) * tile_size * elem_size;
+    slot_count = capacity_bytes / slot_bytes;
+
+    if (slot_count == 0) {
+        return;
+    }
+
+    const char* temp_directory = std::getenv("TMPDIR");
+    std::string path = std::string(temp_directory ? temp_directory : "/tmp") + "/potopoto-tiles-XXXXXX";
+
+    file_descriptor = mkstemp(path.data());
+    if (file_descriptor < 0) {
+        std::cerr << "Failed to create the tile scratch file in " << path << std::endl;
+        return;
+    }
+
+    // Nobody else needs the name, the file goes away with the descriptor
+    unlink(path.c_str());
+
+    // The file stays sparse until slots are written
+    mapping_bytes = slot_count * slot_bytes;
+    if (ftruncate(file_descriptor, static_cast<off_t>(mapping_bytes)) != 0) {
+        std::cerr << "Failed to size the tile scratch file to " << mapping_bytes / (1024 * 1024) << " MB" << std::endl;
+        close(file_descriptor);
+        file_descriptor = -1;
+        return;
+    }
+
+    void* address = mmap(nullptr, mapping_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor, 0);
+    if (address == MAP_FAILED) {
+        std::cerr << "Failed to map the tile scratch file" << std::endl;
+        close(file_descriptor);
+        file_descriptor = -1;
+        return;
+    }
+
+    mapping = static_cast<uint8_t*>(address);
+
+    // Last slot first, so that slots are handed out from the start of the file
+    for (size_t slot = slot_count; slot > 0; slot--) {
+        free_slots.push_back(slot - 1);
+    }
+
+    std::cout << "Mapped tile scratch file of " << mapping_bytes / (1024 * 1024) << " MB, " << slot_count << " slots"
+              << std::endl;
+}
+
+
+MappedTileCache::~MappedTileCache() {
+    if (mapping) {
+        munmap(mapping, mapping_bytes);
+    }
+
+    if (file_descriptor >= 0) {
+        close(file_descriptor);
+    }
+}
+
+
+bool MappedTileCache::Store(int key, const cv::Mat& image) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (!mapping || image.type() != type) {
+        return false;
+    }
+
+    // A source still reads the stored image, which never changes
+    auto stored = entries.find(key);
+    if (stored != entries.end() && stored->second.pins > 0) {
+        return false;
+    }
+
+    RemoveLocked(key);
+
+    std::vector<cv::Rect> tiles = TiledExecutor::SplitIntoTiles(cv::Rect(0, 0, image.cols, image.rows), tile_size);
+
+    if (tiles.size() > slot_count) {
+        return false;
+    }
+
+    // Make room by dropping the least recently used images that no source reads
+    while (free_slots.size() < tiles.size()) {
+        auto oldest = entries.end();
+
+        for (auto entry = entries.begin(); entry != entries.end(); ++entry) {
+            if (entry->second.pins == 0 &&
+                (oldest == entries.end() || entry->second.last_used < oldest->second.last_used)) {
+                oldest = entry;
+            }
+        }
+
+        if (oldest == entries.end()) {
+            return false;
+        }
+
+        RemoveLocked(oldest->first);
+    }
+
+    Entry entry{image.size(), {}, ++use_counter};
+
+    for (const auto& tile : tiles) {
+        size_t slot = free_slots.back();
+        free_slots.pop_back();
+        entry.slots.push_back(slot);
+
+        // Every tile row starts at a multiple of the tile width, also for the tiles at the right and bottom edges
+        cv::Mat slot_pixels(tile.height, tile.width, type, GetSlot(slot), tile_size * elem_size);
+        image(tile).copyTo(slot_pixels);
+    }
+
+    // Start writing back now, the pages can then be dropped without waiting for the disk
+    for (size_t slot : entry.slots) {
+        msync(GetSlot(slot), slot_bytes, MS_ASYNC);
+    }
+
+    entries[key] = std::move(entry);
+    return true;
+}
+
+
+bool MappedTileCache::Read(int key, const cv::Rect& region, cv::Mat& out) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto entry = entries.find(key);
+    if (entry == entries.end() || entry->second.removed) {
+        return false;
+    }
+
+    entry->second.last_used = ++use_counter;
+    ReadLocked(entry->second, region, out);
+    return true;
+}
+
+
+bool MappedTileCache::ReadPinned(int key, const cv::Rect& region, cv::Mat& out) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // The pin keeps the entry, also after it has been removed
+    auto entry = entries.find(key);
+    if (entry == entries.end()) {
+        return false;
+    }
+
+    entry->second.last_used = ++use_counter;
+    ReadLocked(entry->second, region, out);
+    return true;
+}
+
+
+void MappedTileCache::ReadLocked(const Entry& entry, const cv::Rect& region, cv::Mat& out) const {
+    cv::Size size = entry.size;
+    cv::Rect clamped_region = region & cv::Rect(0, 0, size.width, size.height);
+    int tiles_x = (size.width + tile_size - 1) / tile_size;
+
+    out.create(region.size(), type);
+
+    if (clamped_region.empty()) {
+        return;
+    }
+
+    // The OS pages in the overlapped slots, the rest of the image stays on disk
+    for (int tile_y = clamped_region.y / tile_size; tile_y <= (clamped_region.br().y - 1) / tile_size; tile_y++) {
+        for (int tile_x = clamped_region.x / tile_size; tile_x <= (clamped_region.br().x - 1) / tile_size; tile_x++) {
+            cv::Rect tile = cv::Rect(tile_x * tile_size, tile_y * tile_size, tile_size, tile_size) &
+                            cv::Rect(0, 0, size.width, size.height);
+            cv::Rect overlap = tile & clamped_region;
+            uint8_t* slot = GetSlot(entry.slots[tile_y * tiles_x + tile_x]);
+
+            cv::Mat slot_pixels(tile.height, tile.width, type, slot, tile_size * elem_size);
+            cv::Mat out_tile = out(cv::Rect(overlap.x - region.x, overlap.y - region.y, overlap.width, overlap.height));
+            slot_pixels(cv::Rect(overlap.x - tile.x, overlap.y - tile.y, overlap.width, overlap.height)).copyTo(out_tile);
+        }
+    }
+}
+
+
+PixelBuffer::TileSource MappedTileCache::GetSource(int key, cv::Size& size) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto entry = entries.find(key);
+        if (entry == entries.end() || entry->second.removed) {
+            return nullptr;
+        }
+
+        entry->second.pins++;
+        entry->second.last_used = ++use_counter;
+        size = entry->second.size;
+    }
+
+    // Unpins the image once the last copy of the source is gone
+    std::shared_ptr<MappedTileCache> cache = shared_from_this();
+    std::shared_ptr<void> pin(nullptr, [cache, key](void*) { cache->Unpin(key); });
+
+    return [cache, pin, key](const cv::Rect& region, cv::UMat& pixels) {
+        cv::Mat tile;
+        cache->ReadPinned(key, region, tile);
+        tile.copyTo(pixels);
+    };
+}
+
+
+void MappedTileCache::Unpin(int key) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto entry = entries.find(key);
+    if (entry == entries.end()) {
+        return;
+    }
+
+    // Completes a removal that had to wait for the last source
+    if (--entry->second.pins == 0 && entry->second.removed) {
+        RemoveLocked(key);
+    }
+}
+
+
+bool MappedTileCache::Contains(int key) const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto entry = entries.find(key);
+    return entry != entries.end() && !entry->second.removed;
+}
+
+
+void MappedTileCache::Remove(int key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    RemoveLocked(key);
+}
+
+
+void MappedTileCache::Clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (auto entry = entries.begin(); entry != entries.end();) {
+        int key = (entry++)->first;
+        RemoveLocked(key);
+    }
+}
+
+
+size_t MappedTileCache::GetStoredBytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return (slot_count - free_slots.size()) * slot_bytes;
+}
+
+
+void MappedTileCache::RemoveLocked(int key) {
+    auto entry = entries.find(key);
+    if (entry == entries.end()) {
+        return;
+    }
+
+    // Images that sources still read stay until they are unpinned, but are no longer found
+    if (entry->second.pins > 0) {
+        entry->second.removed = true;
+        return;
+    }
+
+    // Free slots are not read again, their pages can go right away
+    for (size_t slot : entry->second.slots) {
+        madvise(GetSlot(slot), slot_bytes, MADV_DONTNEED);
+        free_slots.push_back(slot);
+    }
+
+    entries.erase(entry);
+}
@@ -0,0 +1,79 @@
+#ifndef POTOPOTO_MAPPEDTILECACHE_H
+#define POTOPOTO_MAPPEDTILECACHE_H
+
+#include <opencv2/opencv.hpp>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include <memory>
+
+#include "PixelBuffer.h"
+
+
+// Spill tier for images that do not fit into memory. Images are split into tiles of a fixed layout and written
+// into slots of an unlinked, memory-mapped scratch file. The pages belong to the file, so the OS writes them back
+// and drops them under memory pressure instead of swapping, and pages them in again when they are read.
+class MappedTileCache : public std::enable_shared_from_this<MappedTileCache> {
+public:
+    // The scratch file holds at most capacity_bytes, rounded down to whole slots
+    MappedTileCache(int type, size_t capacity_bytes, int tile_size = DEFAULT_TILE_SIZE);
+    ~MappedTileCache();
+
+    MappedTileCache(const MappedTileCache&) = delete;
+    MappedTileCache& operator=(const MappedTileCache&) = delete;
+
+    bool IsOpen() const { return mapping != nullptr; }
+
+    // Replaces the image stored under the key. The least recently used images are dropped to make room.
+    bool Store(int key, const cv::Mat& image);
+
+    // Reads a region of the image stored under the key. Only the pages of the tiles it overlaps are touched.
+    bool Read(int key, const cv::Rect& region, cv::Mat& out);
+
+    // Source for the regions of the image stored under the key, null if there is none. The image is not dropped
+    // to make room while the source or a copy of it is alive. Expects the cache to be held by a shared_ptr.
+    PixelBuffer::TileSource GetSource(int key, cv::Size& size);
+
+    bool Contains(int key) const;
+    void Remove(int key);
+    void Clear();
+
+    size_t GetStoredBytes() const;
+
+    static const int DEFAULT_TILE_SIZE;
+
+private:
+    struct Entry {
+        cv::Size size;
+        std::vector<size_t> slots;  // One per tile, row-major
+        uint64_t last_used;
+        int pins = 0;   // Sources that read the image
+        bool removed = false;   // Removed while pinned, freed by the last Unpin
+    };
+
+    bool ReadPinned(int key, const cv::Rect& region, cv::Mat& out);
+    void ReadLocked(const Entry& entry, const cv::Rect& region, cv::Mat& out) const;
+    void Unpin(int key);
+    void RemoveLocked(int key);
+    uint8_t* GetSlot(size_t slot) const { return mapping + slot * slot_bytes; }
+
+private:
+    int type;
+    size_t elem_size;
+    int tile_size;
+    size_t slot_bytes;
+    size_t slot_count;
+
+    int file_descriptor;
+    uint8_t* mapping;
+    size_t mapping_bytes;
+
+    std::map<int, Entry> entries;
+    std::vector<size_t> free_slots;
+    uint64_t use_counter;
+    mutable std::mutex mutex;
+};
+
+
+#endif //POTOPOTO_MAPPEDTILECACHE_H
@@ -0,0 +1,166 @@
+#include "MemoryBudget.h"
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+
+
+const double MemoryBudget::DEFAULT_BUDGET_FRACTION = 0.5;  // Of the physical memory, leaves room for other apps
+const size_t MemoryBudget::FALLBACK_BUDGET = size_t(4) * 1024 * 1024 * 1024;
+
+
+MemoryBudget& MemoryBudget::GetInstance() {
+    static MemoryBudget instance;
+    return instance;
+}
+
+
+MemoryBudget::MemoryBudget() : next_handle(1), used_bytes(0), budget(FALLBACK_BUDGET) {
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long page_size = sysconf(_SC_PAGESIZE);
+
+    if (pages > 0 && page_size > 0) {
+        budget = static_cast<size_t>(static_cast<double>(pages) * static_cast<double>(page_size) * DEFAULT_BUDGET_FRACTION);
+    }
+
+    std::cout << "Memory budget is " << budget / (1024 * 1024) << " MB" << std::endl;
+}
+
+
+MemoryBudget::Handle MemoryBudget::Register(Category category, size_t bytes, bool evictable) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    Handle handle = next_handle++;
+    registrations.insert({handle, {category, bytes, evictable, std::chrono::steady_clock::now()}});
+    used_bytes += bytes;
+    return handle;
+}
+
+
+void MemoryBudget::Unregister(Handle handle) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto registration = registrations.find(handle);
+    if (registration == registrations.end()) {
+        return;
+    }
+
+    used_bytes -= registration->second.bytes;
+    registrations.erase(registration);
+}
+
+
+void MemoryBudget::Update(Handle handle, size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto registration = registrations.find(handle);
+    if (registration == registrations.end()) {
+        return;
+    }
+
+    used_bytes = used_bytes - registration->second.bytes + bytes;
+    registration->second.bytes = bytes;
+    registration->second.last_used = std::chrono::steady_clock::now();
+}
+
+
+void MemoryBudget::Touch(Handle handle) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto registration = registrations.find(handle);
+    if (registration != registrations.end()) {
+        registration->second.last_used = std::chrono::steady_clock::now();
+    }
+}
+
+
+bool MemoryBudget::ShouldEvict(Handle handle) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (used_bytes <= budget) {
+        return false;
+    }
+
+    std::vector<std::pair<std::chrono::steady_clock::time_point, Handle>> candidates;
+
+    for (const auto& registration : registrations) {
+        if (registration.second.evictable && registration.second.bytes > 0) {
+            candidates.emplace_back(registration.second.last_used, registration.first);
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end());
+
+    // Walk from the coldest registration until enough bytes would be released
+    size_t excess_bytes = used_bytes - budget;
+    size_t released_bytes = 0;
+
+    for (const auto& candidate : candidates) {
+        if (candidate.second == handle) {
+            return true;
+        }
+
+        released_bytes += registrations.at(candidate.second).bytes;
+
+        if (released_bytes >= excess_bytes) {
+            break;
+        }
+    }
+
+    return false;
+}
+
+
+size_t MemoryBudget::GetExcessBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return used_bytes > budget ? used_bytes - budget : 0;
+}
+
+
+void MemoryBudget::SetBudget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    budget = bytes;
+}
+
+
+size_t MemoryBudget::GetBudget() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return budget;
+}
+
+
+size_t MemoryBudget::GetUsedBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return used_bytes;
+}
+
+
+std::map<MemoryBudget::Category, size_t> MemoryBudget::GetUsedBytesPerCategory() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::map<Category, size_t> used_bytes_per_category;
+
+    for (const auto& registration : registrations) {
+        used_bytes_per_category[registration.second.category] += registration.second.bytes;
+    }
+
+    return used_bytes_per_category;
+}
+
+
+std::string MemoryBudget::GetCategoryName(Category category) {
+    switch (category) {
+        case Category::IMAGE:
+            return "Image";
+        case Category::LOD:
+            return "LOD";
+        case Category::PREVIEW:
+            return "Preview";
+        case Category::LAYER_CACHE:
+            return "Layer cache";
+        case Category::HISTOGRAM:
+            return "Histogram";
+        default:
+            return "Unknown";
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef POTOPOTO_MEMORYBUDGET_H
+#define POTOPOTO_MEMORYBUDGET_H
+
+#include <mutex>
+#include <map>
+#include <unordered_map>
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+
+// Process-wide accounting of large buffers against a memory budget. Owners register the bytes they hold per category.
+// Evictable buffers can be dropped and rebuilt on demand. Their owners ask ShouldEvict at points where dropping them
+// is safe, the budget never calls into them, so it takes no locks of its owners.
+class MemoryBudget {
+public:
+    using Handle = uint64_t;
+
+    enum class Category {
+        IMAGE,          // Full resolution images
+        LOD,            // Pyramid levels of the preview
+        PREVIEW,        // Partial preview images
+        LAYER_CACHE,    // Cached outputs of pipeline steps
+        HISTOGRAM,
+    };
+
+    static MemoryBudget& GetInstance();
+
+    MemoryBudget(const MemoryBudget&) = delete;
+    MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+    Handle Register(Category category, size_t bytes, bool evictable = false);
+    void Unregister(Handle handle);
+    void Update(Handle handle, size_t bytes);
+    void Touch(Handle handle);  // Mark as used, the least recently used registrations are evicted first
+
+    // True if the registration is one of the least recently used evictable ones that have to go to get back under
+    // the budget
+    bool ShouldEvict(Handle handle) const;
+    size_t GetExcessBytes() const;
+
+    void SetBudget(size_t bytes);
+    size_t GetBudget() const;
+    size_t GetUsedBytes() const;
+    std::map<Category, size_t> GetUsedBytesPerCategory() const;
+    static std::string GetCategoryName(Category category);
+
+    static const double DEFAULT_BUDGET_FRACTION;
+    static const size_t FALLBACK_BUDGET;
+
+private:
+    MemoryBudget();
+
+    struct Registration {
+        Category category;
+        size_t bytes;
+        bool evictable;
+        std::chrono::steady_clock::time_point last_used;
+    };
+
+private:
+    mutable std::mutex mutex_;
+    std::unordered_map<Handle, Registration> registrations;
+    Handle next_handle;
+    size_t used_bytes;
+    size_t budget;
+};
+
+
+#endif //POTOPOTO_MEMORYBUDGET_H
@@ -0,0 +1,178 @@
+#include "PixelBuffer.h"
+#include "TiledExecutor.h"
+
+
+const int PixelBuffer::DEFAULT_TILE_SIZE = 256;
+
+
+PixelBuffer::PixelBuffer(const cv::UMat& pixels, bool owned, int my_tile_size) :
+        contiguous(pixels), contiguous_valid(true), size(pixels.size()), type(pixels.type()), elem_size(pixels.elemSize()),
+        tile_size(my_tile_size) {
+    tiles_x = (size.width + tile_size - 1) / tile_size;
+
+    // Row-major, so a tile is found from its grid position
+    for (const auto& rect : TiledExecutor::SplitIntoTiles(cv::Rect(0, 0, size.width, size.height), tile_size)) {
+        tiles.push_back({rect, std::make_shared<cv::UMat>(contiguous(rect)), owned});
+    }
+}
+
+
+PixelBuffer::PixelBuffer(const cv::Size& my_size, int my_type, TileSource my_source, int my_tile_size) :
+        source(std::move(my_source)), size(my_size), type(my_type), elem_size(CV_ELEM_SIZE(my_type)),
+        tile_size(my_tile_size) {
+    tiles_x = (size.width + tile_size - 1) / tile_size;
+
+    for (const auto& rect : TiledExecutor::SplitIntoTiles(cv::Rect(0, 0, size.width, size.height), tile_size)) {
+        tiles.push_back({rect, nullptr, false});
+    }
+}
+
+
+void PixelBuffer::Write(const cv::Rect& region, const cv::UMat& pixels) {
+    cv::Rect clamped_region = region & cv::Rect(0, 0, size.width, size.height);
+
+    if (clamped_region.empty()) {
+        return;
+    }
+
+    int first_x = clamped_region.x / tile_size;
+    int first_y = clamped_region.y / tile_size;
+    int last_x = (clamped_region.x + clamped_region.width - 1) / tile_size;
+    int last_y = (clamped_region.y + clamped_region.height - 1) / tile_size;
+
+    for (int tile_y = first_y; tile_y <= last_y; tile_y++) {
+        for (int tile_x = first_x; tile_x <= last_x; tile_x++) {
+            Tile& tile = tiles[tile_y * tiles_x + tile_x];
+
+            if (!tile.pixels) {
+                tile.pixels = ReadTile(tile);
+                tile.owned = true;
+                contiguous_valid = false;
+            } else if (IsTileShared(tile)) {
+                tile.pixels = std::make_shared<cv::UMat>(tile.pixels->clone());
+                tile.owned = true;
+                contiguous_valid = false;
+            }
+
+            cv::Rect overlap = clamped_region & tile.rect;
+            cv::Rect source_rect(overlap.x - region.x, overlap.y - region.y, overlap.width, overlap.height);
+            cv::Rect tile_rect(overlap.x - tile.rect.x, overlap.y - tile.rect.y, overlap.width, overlap.height);
+
+            cv::UMat tile_region = (*tile.pixels)(tile_rect);
+            pixels(source_rect).copyTo(tile_region);
+        }
+    }
+}
+
+
+cv::UMat PixelBuffer::Read(const cv::Rect& region) const {
+    cv::Rect clamped_region = region & cv::Rect(0, 0, size.width, size.height);
+
+    if (clamped_region.empty()) {
+        return cv::UMat();
+    }
+
+    if (contiguous_valid) {
+        return contiguous(clamped_region);
+    }
+
+    int first_x = clamped_region.x / tile_size;
+    int first_y = clamped_region.y / tile_size;
+    int last_x = (clamped_region.x + clamped_region.width - 1) / tile_size;
+    int last_y = (clamped_region.y + clamped_region.height - 1) / tile_size;
+
+    // Inside a single tile that holds its pixels
+    const Tile& first_tile = tiles[first_y * tiles_x + first_x];
+
+    if (first_x == last_x && first_y == last_y && first_tile.pixels) {
+        cv::Rect tile_rect(clamped_region.x - first_tile.rect.x, clamped_region.y - first_tile.rect.y,
+                           clamped_region.width, clamped_region.height);
+        return (*first_tile.pixels)(tile_rect);
+    }
+
+    cv::UMat pixels(clamped_region.size(), type);
+
+    for (int tile_y = first_y; tile_y <= last_y; tile_y++) {
+        for (int tile_x = first_x; tile_x <= last_x; tile_x++) {
+            const Tile& tile = tiles[tile_y * tiles_x + tile_x];
+            cv::Rect overlap = clamped_region & tile.rect;
+            cv::UMat pixels_region = pixels(cv::Rect(overlap.x - clamped_region.x, overlap.y - clamped_region.y,
+                                                     overlap.width, overlap.height));
+
+            // Tiles that were never written stay unread, only the overlap is taken from the source
+            if (tile.pixels) {
+                (*tile.pixels)(cv::Rect(overlap.x - tile.rect.x, overlap.y - tile.rect.y, overlap.width,
+                                        overlap.height)).copyTo(pixels_region);
+            } else {
+                source(overlap, pixels_region);
+            }
+        }
+    }
+
+    return pixels;
+}
+
+
+cv::UMat PixelBuffer::GetContiguous() const {
+    if (contiguous_valid) {
+        return contiguous;
+    }
+
+    // Some tiles live in buffers of their own. Gather everything and let the tiles point into the new buffer,
+    // the pixels that were shared with other buffers become private.
+    cv::UMat gathered(size, type);
+
+    for (auto& tile : tiles) {
+        cv::UMat gathered_tile = gathered(tile.rect);
+
+        if (tile.pixels) {
+            tile.pixels->copyTo(gathered_tile);
+        } else {
+            source(tile.rect, gathered_tile);
+        }
+
+        tile.pixels = std::make_shared<cv::UMat>(gathered_tile);
+        tile.owned = true;
+    }
+
+    contiguous = gathered;
+    contiguous_valid = true;
+    return contiguous;
+}
+
+
+size_t PixelBuffer::GetPrivateBytes() const {
+    size_t bytes = 0;
+
+    for (const auto& tile : tiles) {
+        if (tile.pixels && !IsTileShared(tile)) {
+            bytes += tile.rect.area() * elem_size;
+        }
+    }
+
+    return bytes;
+}
+
+
+void PixelBuffer::ReplaceBorrowedTiles(TileSource new_source) {
+    source = std::move(new_source);
+
+    for (auto& tile : tiles) {
+        if (!tile.owned) {
+            tile.pixels.reset();
+            contiguous_valid = false;
+        }
+    }
+
+    // The contiguous buffer may be the borrowed pixels themselves
+    if (!contiguous_valid) {
+        contiguous = cv::UMat();
+    }
+}
+
+
+std::shared_ptr<cv::UMat> PixelBuffer::ReadTile(const Tile& tile) const {
+    auto pixels = std::make_shared<cv::UMat>(tile.rect.size(), type);
+    source(tile.rect, *pixels);
+    return pixels;
+}
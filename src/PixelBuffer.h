@@ -0,0 +1,72 @@
+#ifndef POTOPOTO_PIXELBUFFER_H
+#define POTOPOTO_PIXELBUFFER_H
+
+#include <opencv2/opencv.hpp>
+#include <memory>
+#include <vector>
+#include <functional>
+
+
+// Reference-counted pixel storage with copy-on-write tiles. Copies of a buffer share all pixels. Writing a region
+// copies only the tiles it touches that are still shared, the other tiles stay shared.
+class PixelBuffer {
+public:
+    // Copies the pixels of a rectangle into an allocated buffer of its size. Unwritten tiles of a lazy buffer
+    // come from here.
+    using TileSource = std::function<void(const cv::Rect&, cv::UMat&)>;
+
+    PixelBuffer() = default;
+
+    // Wraps the pixels without copying them. Pixels the buffer does not own are copied tile by tile before
+    // they are written.
+    explicit PixelBuffer(const cv::UMat& pixels, bool owned = false, int tile_size = DEFAULT_TILE_SIZE);
+
+    // Holds no pixels until tiles are written or the buffer is gathered, they are read from the source then
+    PixelBuffer(const cv::Size& size, int type, TileSource source, int tile_size = DEFAULT_TILE_SIZE);
+
+    cv::Size GetSize() const { return size; }
+    int GetType() const { return type; }
+
+    // Write the pixels, which have the size of the region, into the region
+    void Write(const cv::Rect& region, const cv::UMat& pixels);
+
+    // Pixels of a region. A view if they lie in one buffer, otherwise the overlapped tiles are copied, or read
+    // from the source, into a new buffer. Unlike GetContiguous, the tiles are left as they are.
+    cv::UMat Read(const cv::Rect& region) const;
+
+    // The whole image as one buffer. Free as long as no tile has been copied. Otherwise the tiles are gathered
+    // into a new buffer, which then backs all tiles of this buffer.
+    cv::UMat GetContiguous() const;
+
+    // Bytes of the tiles that no other buffer shares
+    size_t GetPrivateBytes() const;
+
+    // Drops the tiles that still borrow outside pixels, they are read from the source again when needed
+    void ReplaceBorrowedTiles(TileSource source);
+
+    static const int DEFAULT_TILE_SIZE;
+
+private:
+    struct Tile {
+        cv::Rect rect;
+        std::shared_ptr<cv::UMat> pixels;   // Null until the tile is read from the source
+        bool owned;     // False while the pixels belong to someone outside of the buffers
+    };
+
+    static bool IsTileShared(const Tile& tile) { return !tile.owned || tile.pixels.use_count() > 1; }
+    std::shared_ptr<cv::UMat> ReadTile(const Tile& tile) const;
+
+private:
+    mutable cv::UMat contiguous;            // Backs every tile that has not been copied
+    mutable bool contiguous_valid = false;  // No tile has been copied since the buffer was last gathered
+    mutable std::vector<Tile> tiles;
+    TileSource source;
+    cv::Size size;
+    int type = 0;
+    size_t elem_size = 0;
+    int tile_size = DEFAULT_TILE_SIZE;
+    int tiles_x = 0;
+};
+
+
+#endif //POTOPOTO_PIXELBUFFER_H
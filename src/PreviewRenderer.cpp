@@ -0,0 +1,193 @@
+#include "PreviewRenderer.h"
+
+
+PreviewRenderer::PreviewRenderer(const std::shared_ptr<ImagePreview>& in_image_preview) :
+        image_preview(in_image_preview),
+        is_rendering(false),
+        is_stopping(false),
+        dropped_requests(0) {
+    render_thread = std::thread(&PreviewRenderer::RenderLoop, this);
+}
+
+
+PreviewRenderer::~PreviewRenderer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        is_stopping = true;
+        pending_request.reset();
+    }
+
+    cv.notify_all();
+    render_thread.join();
+}
+
+
+void PreviewRenderer::SetHistogram(const std::shared_ptr<ImageHistogram>& in_histogram) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    histogram = in_histogram;
+}
+
+
+void PreviewRenderer::SetFrameCallback(FrameCallback callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    frame_callback = std::move(callback);
+}
+
+
+void PreviewRenderer::SetHistogramCallback(HistogramCallback callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    histogram_callback = std::move(callback);
+}
+
+
+void PreviewRenderer::SetLodCallback(LodCallback callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    lod_callback = std::move(callback);
+}
+
+
+void PreviewRenderer::SetUploadBufferPool(const std::shared_ptr<UploadBufferPool>& pool) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    upload_buffer_pool = pool;
+}
+
+
+void PreviewRenderer::Post(const Request& request) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        Request merged_request = request;
+
+        if (pending_request) {
+            dropped_requests++;
+
+            if (!merged_request.parameters) {
+                merged_request.parameters = pending_request->parameters;
+                merged_request.refine_lods = pending_request->refine_lods;
+            }
+        }
+
+        pending_request = merged_request;
+    }
+
+    cv.notify_all();
+}
+
+
+void PreviewRenderer::WaitUntilIdle() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    pending_request.reset();
+    cv.wait(lock, [this] { return !is_rendering; });
+}
+
+
+void PreviewRenderer::CopyFramePixels(ImagePreview::Frame& frame, const std::shared_ptr<UploadBufferPool>& pool) {
+    if (frame.pixels.empty()) {
+        return;
+    }
+
+    // Written straight into memory the GL thread has mapped, which then only starts the transfer
+    UploadBufferPool::Buffer buffer;
+    size_t bytes = frame.pixels.total() * frame.pixels.elemSize();
+
+    if (pool && pool->Take(bytes, buffer)) {
+        cv::Mat mapped_pixels(frame.pixels.rows, frame.pixels.cols, frame.pixels.type(), buffer.data);
+        frame.pixels.copyTo(mapped_pixels);
+        pool->FinishWriting(buffer.index);
+        frame.pixels = mapped_pixels;
+        frame.upload_buffer = buffer.index;
+        frame.buffer.reset();   // The view is released first, as OpenCV requires
+        return;
+    }
+
+    frame.pixels = frame.pixels.clone();
+    frame.buffer.reset();
+}
+
+
+bool PreviewRenderer::IsBusy() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return is_rendering || pending_request.has_value();
+}
+
+
+bool PreviewRenderer::HasPendingRequest() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_request.has_value();
+}
+
+
+void PreviewRenderer::RenderLoop() {
+    while (true) {
+        Request request;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv.wait(lock, [this] { return is_stopping || pending_request.has_value(); });
+
+            if (is_stopping) {
+                return;
+            }
+
+            request = *pending_request;
+            pending_request.reset();
+            is_rendering = true;
+        }
+
+        Render(request);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            is_rendering = false;
+        }
+
+        cv.notify_all();
+    }
+}
+
+
+void PreviewRenderer::Render(const Request& request) {
+    FrameCallback on_frame;
+    HistogramCallback on_histogram;
+    LodCallback on_lod;
+    std::shared_ptr<ImageHistogram> current_histogram;
+    std::shared_ptr<UploadBufferPool> pool;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        on_frame = frame_callback;
+        on_histogram = histogram_callback;
+        on_lod = lod_callback;
+        current_histogram = histogram;
+        pool = upload_buffer_pool;
+    }
+
+    if (request.parameters) {
+        image_preview->AdjustParameters(request.parameters);
+    }
+
+    image_preview->ApplyAdjustmentsForPreviewRegion(request.visible_region);
+
+    // Only the visible part of the changed region is copied, the preview keeps changing while the GL thread uploads it
+    if (on_frame) {
+        ImagePreview::Frame frame = image_preview->GetFrame(request.visible_region);
+        CopyFramePixels(frame, pool);
+        on_frame(frame);
+    }
+
+    if (request.refine_lods) {
+        image_preview->ApplyAdjustmentsForAllLodsAsync(on_lod);
+    }
+
+    // The histogram covers the full image and is the slowest part. Leave it to the next request if there is one.
+    if (current_histogram == nullptr || request.parameters == nullptr || HasPendingRequest()) {
+        return;
+    }
+
+    current_histogram->AdjustParameters(request.parameters);
+    current_histogram->ApplyAdjustments();
+
+    if (on_histogram) {
+        on_histogram(current_histogram->GetHistogram());
+    }
+}
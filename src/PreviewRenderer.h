@@ -0,0 +1,81 @@
+#ifndef POTOPOTO_PREVIEWRENDERER_H
+#define POTOPOTO_PREVIEWRENDERER_H
+
+#include <opencv2/opencv.hpp>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include <atomic>
+#include <functional>
+
+#include "ImagePreview.h"
+#include "ImageHistogram.h"
+#include "AdjustmentsParameters.h"
+#include "UploadBufferPool.h"
+
+
+// Runs the interactive preview on its own thread. Requests go through a single slot mailbox where the latest request
+// wins, so values a slider has already moved past are never processed. Results are handed back through callbacks,
+// which are called on the render thread.
+class PreviewRenderer {
+public:
+    struct Request {
+        std::shared_ptr<AdjustmentsParameters> parameters;
+        cv::Rect visible_region;
+        bool refine_lods = false;   // Process all LOD images after the preview, e.g. when a slider is released
+    };
+
+    using FrameCallback = std::function<void(const ImagePreview::Frame& frame)>;
+    using HistogramCallback = std::function<void(const std::vector<cv::Mat>& histogram)>;
+    using LodCallback = std::function<void(ImagePreview::LodLevel lod_level)>;
+
+    PreviewRenderer(const std::shared_ptr<ImagePreview>& in_image_preview);
+    ~PreviewRenderer();
+
+    void SetHistogram(const std::shared_ptr<ImageHistogram>& in_histogram);
+    void SetFrameCallback(FrameCallback callback);
+    void SetHistogramCallback(HistogramCallback callback);
+    void SetLodCallback(LodCallback callback);
+
+    // Frames are copied straight into the mapped buffers of the pool when one is available
+    void SetUploadBufferPool(const std::shared_ptr<UploadBufferPool>& pool);
+
+    // Replaces a request that has not been started yet. Never waits for pixel processing. A request without
+    // parameters only moves the viewport and keeps the parameters of the replaced request.
+    void Post(const Request& request);
+
+    // Drops the pending request and waits for the running one, e.g. before the image is replaced
+    void WaitUntilIdle();
+
+    size_t GetDroppedRequestCount() const { return dropped_requests; }
+
+    // A request is waiting or being rendered, i.e. a newer frame is on its way
+    bool IsBusy();
+
+private:
+    void RenderLoop();
+    void Render(const Request& request);
+    bool HasPendingRequest();
+    void CopyFramePixels(ImagePreview::Frame& frame, const std::shared_ptr<UploadBufferPool>& pool);
+
+private:
+    std::shared_ptr<ImagePreview> image_preview;
+    std::shared_ptr<ImageHistogram> histogram;
+
+    FrameCallback frame_callback;
+    HistogramCallback histogram_callback;
+    LodCallback lod_callback;
+    std::shared_ptr<UploadBufferPool> upload_buffer_pool;
+
+    std::thread render_thread;
+    std::mutex mutex_;
+    std::condition_variable cv;
+    std::optional<Request> pending_request;
+    bool is_rendering;
+    bool is_stopping;
+    std::atomic<size_t> dropped_requests;
+};
+
+
+#endif //POTOPOTO_PREVIEWRENDERER_H
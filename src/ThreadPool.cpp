@@ -0,0 +1,107 @@
+#include "ThreadPool.h"
+#include <iostream>
+
+
+const int ThreadPool::WORKER_COUNT = 4; // One per LOD level and one for the viewport prefetch
+
+// Priority of the job running on this thread. Threads outside the pool, like the UI thread, count as high priority.
+static thread_local ThreadPool::Priority current_priority = ThreadPool::Priority::HIGH;
+
+
+ThreadPool& ThreadPool::GetInstance() {
+    static ThreadPool instance(WORKER_COUNT);
+    return instance;
+}
+
+
+ThreadPool::ThreadPool(int worker_count) : is_stopping(false), busy_workers(0), busy_high_priority_workers(0) {
+    thread_budget = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+    for (int i = 0; i < worker_count; ++i) {
+        workers.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+
+    std::cout << "Thread pool started with " << worker_count << " workers and a budget of "
+              << thread_budget << " kernel threads" << std::endl;
+}
+
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        is_stopping = true;
+    }
+
+    cv.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+
+std::future<void> ThreadPool::Submit(Job job, Priority priority) {
+    std::packaged_task<void()> packaged_job(std::move(job));
+    std::future<void> future = packaged_job.get_future();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& jobs = priority == Priority::HIGH ? high_priority_jobs : low_priority_jobs;
+        jobs.push_back(std::move(packaged_job));
+    }
+
+    cv.notify_one();
+    return future;
+}
+
+
+int ThreadPool::GetKernelThreadCount() const {
+    int high_priority_jobs_running = busy_high_priority_workers.load();
+
+    // Background jobs keep a single thread while the user waits for high priority work
+    if (current_priority == Priority::LOW && high_priority_jobs_running > 0) {
+        return 1;
+    }
+
+    // Otherwise the cores are split evenly between the jobs that may use them. Callers outside the pool get the
+    // same share as the high priority jobs.
+    int sharing_jobs = high_priority_jobs_running > 0 ? high_priority_jobs_running : busy_workers.load();
+    return std::max(1, thread_budget / std::max(1, sharing_jobs));
+}
+
+
+void ThreadPool::WorkerLoop() {
+    while (true) {
+        std::packaged_task<void()> job;
+        Priority priority;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv.wait(lock, [this] { return is_stopping || !high_priority_jobs.empty() || !low_priority_jobs.empty(); });
+
+            if (is_stopping && high_priority_jobs.empty() && low_priority_jobs.empty()) {
+                return;
+            }
+
+            priority = !high_priority_jobs.empty() ? Priority::HIGH : Priority::LOW;
+            auto& jobs = priority == Priority::HIGH ? high_priority_jobs : low_priority_jobs;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        current_priority = priority;
+        busy_workers++;
+
+        if (priority == Priority::HIGH) {
+            busy_high_priority_workers++;
+        }
+
+        job();
+
+        if (priority == Priority::HIGH) {
+            busy_high_priority_workers--;
+        }
+
+        busy_workers--;
+    }
+}
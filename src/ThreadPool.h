@@ -0,0 +1,60 @@
+#ifndef POTOPOTO_THREADPOOL_H
+#define POTOPOTO_THREADPOOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <deque>
+#include <vector>
+#include <atomic>
+
+
+// Process-wide pool of persistent workers for background jobs. The pool also owns the thread budget of the parallel
+// kernels: jobs running concurrently split the cores between them instead of each forking a full OpenMP team.
+class ThreadPool {
+public:
+    using Job = std::function<void()>;
+
+    enum class Priority {
+        HIGH,       // Work the user is waiting for
+        LOW,        // Background refinement
+    };
+
+    static ThreadPool& GetInstance();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Queue a job. High priority jobs are picked first. The future becomes ready when the job has returned.
+    std::future<void> Submit(Job job, Priority priority = Priority::HIGH);
+
+    // Number of threads a parallel kernel may use right now. While high priority work is running,
+    // low priority jobs are held to a single thread.
+    int GetKernelThreadCount() const;
+    int GetThreadBudget() const { return thread_budget; }
+
+    static const int WORKER_COUNT;
+
+private:
+    ThreadPool(int worker_count);
+    ~ThreadPool();
+
+    void WorkerLoop();
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::packaged_task<void()>> high_priority_jobs;
+    std::deque<std::packaged_task<void()>> low_priority_jobs;
+    std::mutex mutex_;
+    std::condition_variable cv;
+    bool is_stopping;
+
+    int thread_budget;
+    std::atomic<int> busy_workers;
+    std::atomic<int> busy_high_priority_workers;
+};
+
+
+#endif //POTOPOTO_THREADPOOL_H
@@ -0,0 +1,161 @@
+#include "TileCodec.h"
+#include <cstring>
+
+
+const int TileCodec::HASH_BITS = 12;            // 16 KB of positions, stays in L1
+const size_t TileCodec::MIN_MATCH = 4;
+const size_t TileCodec::MAX_OFFSET = 65535;
+
+
+static inline uint32_t ReadU32(const uint8_t* data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+
+static inline void WriteLength(std::vector<uint8_t>& out, size_t length) {
+    // Lengths of 15 and more continue in bytes of 255 and a final remainder
+    while (length >= 255) {
+        out.push_back(255);
+        length -= 255;
+    }
+
+    out.push_back(static_cast<uint8_t>(length));
+}
+
+
+static inline bool ReadLength(const uint8_t*& in, const uint8_t* in_end, size_t& length) {
+    uint8_t value;
+
+    do {
+        if (in >= in_end) {
+            return false;
+        }
+
+        value = *in++;
+        length += value;
+    } while (value == 255);
+
+    return true;
+}
+
+
+static void WriteSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literal_length,
+                          size_t offset, size_t match_length) {
+    size_t match_code = match_length >= 4 ? match_length - 4 : 0;
+    uint8_t token = static_cast<uint8_t>((std::min<size_t>(literal_length, 15) << 4) | std::min<size_t>(match_code, 15));
+    out.push_back(token);
+
+    if (literal_length >= 15) {
+        WriteLength(out, literal_length - 15);
+    }
+
+    out.insert(out.end(), literals, literals + literal_length);
+
+    // The last sequence carries literals only
+    if (match_length == 0) {
+        return;
+    }
+
+    out.push_back(static_cast<uint8_t>(offset & 0xff));
+    out.push_back(static_cast<uint8_t>(offset >> 8));
+
+    if (match_code >= 15) {
+        WriteLength(out, match_code - 15);
+    }
+}
+
+
+std::vector<uint8_t> TileCodec::Compress(const uint8_t* data, size_t size) {
+    std::vector<uint8_t> out;
+    out.reserve(size / 2 + 16);
+
+    std::vector<uint32_t> hash_table(size_t(1) << HASH_BITS, 0);
+    const uint8_t* anchor = data;
+    size_t position = 0;
+
+    while (size >= MIN_MATCH && position + MIN_MATCH <= size) {
+        uint32_t sequence = ReadU32(data + position);
+        uint32_t hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+        size_t candidate = hash_table[hash];
+        hash_table[hash] = static_cast<uint32_t>(position);
+
+        if (candidate >= position || position - candidate > MAX_OFFSET || ReadU32(data + candidate) != sequence) {
+            position++;
+            continue;
+        }
+
+        size_t match_length = MIN_MATCH;
+        while (position + match_length < size && data[candidate + match_length] == data[position + match_length]) {
+            match_length++;
+        }
+
+        WriteSequence(out, anchor, data + position - anchor, position - candidate, match_length);
+
+        position += match_length;
+        anchor = data + position;
+    }
+
+    WriteSequence(out, anchor, data + size - anchor, 0, 0);
+    return out;
+}
+
+
+bool TileCodec::Decompress(const std::vector<uint8_t>& compressed, uint8_t* out, size_t size) {
+    const uint8_t* in = compressed.data();
+    const uint8_t* in_end = in + compressed.size();
+    uint8_t* out_position = out;
+    uint8_t* out_end = out + size;
+
+    while (in < in_end) {
+        uint8_t token = *in++;
+
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !ReadLength(in, in_end, literal_length)) {
+            return false;
+        }
+
+        if (literal_length > static_cast<size_t>(in_end - in) || literal_length > static_cast<size_t>(out_end - out_position)) {
+            return false;
+        }
+
+        if (literal_length > 0) {
+            std::memcpy(out_position, in, literal_length);
+        }
+        in += literal_length;
+        out_position += literal_length;
+
+        // Literals only, the end of the block
+        if (in >= in_end) {
+            break;
+        }
+
+        if (in_end - in < 2) {
+            return false;
+        }
+
+        size_t offset = in[0] | (in[1] << 8);
+        in += 2;
+
+        size_t match_length = token & 0x0f;
+        if (match_length == 15 && !ReadLength(in, in_end, match_length)) {
+            return false;
+        }
+        match_length += MIN_MATCH;
+
+        if (offset == 0 || offset > static_cast<size_t>(out_position - out) ||
+            match_length > static_cast<size_t>(out_end - out_position)) {
+            return false;
+        }
+
+        // Byte by byte, matches may overlap their own output
+        const uint8_t* match = out_position - offset;
+        for (size_t i = 0; i < match_length; i++) {
+            out_position[i] = match[i];
+        }
+        out_position += match_length;
+    }
+
+    return out_position == out_end;
+}
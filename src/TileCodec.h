@@ -0,0 +1,25 @@
+#ifndef POTOPOTO_TILECODEC_H
+#define POTOPOTO_TILECODEC_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+// Fast byte-oriented LZ77 codec in the spirit of LZ4: greedy matching through a small hash table, no entropy coding.
+// A sequence is a token with the literal and match lengths, the literals, a 16 bit match offset and length extensions.
+class TileCodec {
+public:
+    static std::vector<uint8_t> Compress(const uint8_t* data, size_t size);
+
+    // The decompressed size has to be known. Returns false on corrupt input.
+    static bool Decompress(const std::vector<uint8_t>& compressed, uint8_t* out, size_t size);
+
+private:
+    static const int HASH_BITS;
+    static const size_t MIN_MATCH;
+    static const size_t MAX_OFFSET;
+};
+
+
+#endif //POTOPOTO_TILECODEC_H
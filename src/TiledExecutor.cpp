@@ -0,0 +1,32 @@
+#include "TiledExecutor.h"
+#include "ThreadPool.h"
+
+
+const int TiledExecutor::DEFAULT_TILE_SIZE = 256; // 256x256 RGB pixels fit into a per-core L2 cache
+
+
+std::vector<cv::Rect> TiledExecutor::SplitIntoTiles(const cv::Rect& region, int tile_size) {
+    std::vector<cv::Rect> tiles;
+
+    for (int y = region.y; y < region.y + region.height; y += tile_size) {
+        for (int x = region.x; x < region.x + region.width; x += tile_size) {
+            int width = std::min(tile_size, region.x + region.width - x);
+            int height = std::min(tile_size, region.y + region.height - y);
+            tiles.emplace_back(x, y, width, height);
+        }
+    }
+
+    return tiles;
+}
+
+
+void TiledExecutor::Run(const cv::Rect& region, const TileFunction& tile_function, int tile_size) {
+    std::vector<cv::Rect> tiles = SplitIntoTiles(region, tile_size);
+    int tile_count = static_cast<int>(tiles.size());
+    int thread_count = ThreadPool::GetInstance().GetKernelThreadCount();
+
+#pragma omp parallel for schedule(dynamic) num_threads(thread_count)
+    for (int i = 0; i < tile_count; ++i) {
+        tile_function(tiles[i]);
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef POTOPOTO_TILEDEXECUTOR_H
+#define POTOPOTO_TILEDEXECUTOR_H
+
+#include <opencv2/opencv.hpp>
+#include <functional>
+#include <vector>
+
+
+// Splits a region into tiles and schedules them dynamically across all cores
+class TiledExecutor {
+public:
+    using TileFunction = std::function<void(const cv::Rect& tile)>;
+
+    static std::vector<cv::Rect> SplitIntoTiles(const cv::Rect& region, int tile_size = DEFAULT_TILE_SIZE);
+    static void Run(const cv::Rect& region, const TileFunction& tile_function, int tile_size = DEFAULT_TILE_SIZE);
+
+    static const int DEFAULT_TILE_SIZE;
+};
+
+
+#endif //POTOPOTO_TILEDEXECUTOR_H
@@ -0,0 +1,58 @@
+#include "UploadBufferPool.h"
+
+
+void UploadBufferPool::Offer(const Buffer& buffer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    offered_buffers.push_back(buffer);
+}
+
+
+bool UploadBufferPool::Take(size_t bytes, Buffer& buffer) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (auto offered_buffer = offered_buffers.begin(); offered_buffer != offered_buffers.end(); ++offered_buffer) {
+        if (offered_buffer->capacity >= bytes) {
+            buffer = *offered_buffer;
+            taken_buffers.insert(buffer.index);
+            writing_buffers.insert(buffer.index);
+            offered_buffers.erase(offered_buffer);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+void UploadBufferPool::FinishWriting(int index) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        writing_buffers.erase(index);
+    }
+
+    written.notify_all();
+}
+
+
+bool UploadBufferPool::Return(int index) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return taken_buffers.erase(index) > 0;
+}
+
+
+std::vector<UploadBufferPool::Buffer> UploadBufferPool::Reclaim() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<Buffer> buffers;
+    buffers.swap(offered_buffers);
+    return buffers;
+}
+
+
+void UploadBufferPool::Drain() {
+    std::unique_lock<std::mutex> lock(mutex);
+    written.wait(lock, [this] { return writing_buffers.empty(); });
+
+    offered_buffers.clear();
+    taken_buffers.clear();
+}
@@ -0,0 +1,51 @@
+#ifndef POTOPOTO_UPLOADBUFFERPOOL_H
+#define POTOPOTO_UPLOADBUFFERPOOL_H
+
+#include <vector>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+
+
+// Hands mapped pixel buffers from the GL thread to a worker and back. The GL thread maps a buffer and offers it,
+// a worker takes it and writes a frame into it, and the GL thread starts the transfer once the frame comes back.
+// The pool itself never calls GL, so workers can use it without a GL context.
+class UploadBufferPool {
+public:
+    struct Buffer {
+        int index = -1;             // Buffer of the GL thread
+        uint8_t* data = nullptr;    // Mapped memory, valid until the buffer is returned
+        size_t capacity = 0;
+    };
+
+    // GL thread, the buffer is mapped
+    void Offer(const Buffer& buffer);
+
+    // Worker, false if no offered buffer has room for the bytes
+    bool Take(size_t bytes, Buffer& buffer);
+
+    // Worker, once the frame has been written into a taken buffer
+    void FinishWriting(int index);
+
+    // GL thread, once the frame written into the buffer has arrived. False if the buffer was not taken.
+    bool Return(int index);
+
+    // GL thread, offered buffers that have not been taken, e.g. to map them with a larger capacity
+    std::vector<Buffer> Reclaim();
+
+    // GL thread, waits until no worker writes into a buffer and forgets all of them, e.g. before they are unmapped.
+    // Frames written into the taken buffers can no longer be returned and are dropped.
+    void Drain();
+
+private:
+    std::vector<Buffer> offered_buffers;
+    std::set<int> taken_buffers;
+    std::set<int> writing_buffers;  // Taken buffers a worker still writes into
+    std::mutex mutex;
+    std::condition_variable written;
+};
+
+
+#endif //POTOPOTO_UPLOADBUFFERPOOL_H
@@ -3,6 +3,13 @@
 #include <random>
 #include <sstream>
 #include <iomanip>
+#include <fstream>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
 
 std::string Utils::GenerateGuid() {
     std::random_device rd;
@@ -40,4 +47,44 @@ std::string Utils::GenerateGuid() {
     }
 
     return ss.str();
-}
\ No newline at end of file
+}
+
+
+size_t Utils::GetResidentMemory() {
+#ifdef __APPLE__
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS) {
+        return 0;
+    }
+
+    return info.resident_size;
+#else
+    // Second field is the number of resident pages
+    std::ifstream statm("/proc/self/statm");
+    size_t total_pages = 0;
+    size_t resident_pages = 0;
+
+    if (!(statm >> total_pages >> resident_pages)) {
+        return 0;
+    }
+
+    return resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+
+size_t Utils::GetPeakResidentMemory() {
+    struct rusage usage {};
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss);        // Bytes on macOS
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024; // Kilobytes on Linux
+#endif
+}
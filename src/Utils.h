@@ -2,10 +2,15 @@
 #define POTOPOTO_UTILS_H
 
 #include <string>
+#include <cstddef>
 
 class Utils {
 public:
     static std::string GenerateGuid();
+
+    // Resident set size of the process in bytes, 0 if it cannot be determined
+    static size_t GetResidentMemory();
+    static size_t GetPeakResidentMemory();
 };
 
 
@@ -1,5 +1,49 @@
 #include "ImageCanvas.h"
 
+namespace {
+    // GLSL 1.20 for legacy contexts, e.g. macOS and software renderers like llvmpipe
+    const char* LUT_VERTEX_SHADER = R"(
+        #version 120
+        void main() {
+            gl_TexCoord[0] = gl_MultiTexCoord0;
+            gl_Position = ftransform();
+        }
+    )";
+
+    // The lattice points sit in the texel centers, the coordinates are scaled so that 0 and 1 hit the outer ones
+    const char* LUT_FRAGMENT_SHADER = R"(
+        #version 120
+        uniform sampler2D image;
+        uniform sampler3D lookupTable;
+        uniform float latticeScale;
+        uniform float latticeOffset;
+
+        void main() {
+            vec4 color = texture2D(image, gl_TexCoord[0].st);
+            gl_FragColor = vec4(texture3D(lookupTable, color.rgb * latticeScale + latticeOffset).rgb, color.a);
+        }
+    )";
+
+    GLuint CompileShader(GLenum type, const char* source) {
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, nullptr);
+        glCompileShader(shader);
+
+        GLint compiled = GL_FALSE;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+
+        if (compiled != GL_TRUE) {
+            char log[1024] = {0};
+            glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+            std::cerr << "Failed to compile shader: " << log << std::endl;
+            glDeleteShader(shader);
+            return 0;
+        }
+
+        return shader;
+    }
+}
+
 wxBEGIN_EVENT_TABLE(ImageCanvas, wxGLCanvas)
                 EVT_PAINT(ImageCanvas::OnPaint)
                 EVT_SIZE(ImageCanvas::OnResize)
@@ -10,21 +54,28 @@ wxEND_EVENT_TABLE()
 
 ImageCanvas::ImageCanvas(wxWindow *parent, std::shared_ptr<ImagePreview> imagePreview)
         : wxGLCanvas(parent, wxID_ANY, nullptr), imagePreview(imagePreview), zoomFactor(1.0f),
-          offsetX(0.0f), offsetY(0.0f), imageLoaded(false), textureId(0), isDragging(false),
-          currentLodLevel(ImagePreview::LodLevel::LOW) {
+          offsetX(0.0f), offsetY(0.0f), imageLoaded(false), isDragging(false),
+          viewportVelocity(0.0f, 0.0f), textureTileSize(0), paintCounter(0), uploadBufferCapacity(0),
+          uploadBufferPool(std::make_shared<UploadBufferPool>()), lutProgram(0), lutTexture(0), lutShaderFailed(false),
+          frameTimer(this), framePending(false), textureUpdatePending(false), currentLodLevel(0) {
     SetBackgroundStyle(wxBG_STYLE_PAINT);
     glContext = new wxGLContext(this);
+
+    Bind(wxEVT_TIMER, &ImageCanvas::OnFrameTimer, this, frameTimer.GetId());
 }
 
 
 ImageCanvas::~ImageCanvas() {
+    frameTimer.Stop();
+
+    // The textures and buffers belong to the context
+    DeleteTextures();
+    DeleteUploadBuffers();
+    DeleteLookupTableShader();
+
     if (glContext) {
         delete glContext;
     }
-
-    if (textureId) {
-        glDeleteTextures(1, &textureId);
-    }
 }
 
 
@@ -38,47 +89,52 @@ void ImageCanvas::Reset() {
     dragStartPos = wxPoint(0, 0);
     lastOffsetX = 0.0f;
     lastOffsetY = 0.0f;
-    currentLodLevel = ImagePreview::LodLevel::LOW;
+    viewportVelocity = cv::Point2f(0.0f, 0.0f);
+    currentLodLevel = 0;
+    shaderParameters.reset();
 
-    if (textureId) {
-        glDeleteTextures(1, &textureId);
-        textureId = 0;
-    }
+    pendingFrames.clear();
+    textureUpdatePending = false;
 
-    Refresh();  // This will trigger OnPaint to clear the canvas to dark grey
+    // The upload buffers are mapped again for the next image, frames of this one that are still on their way
+    // are dropped
+    DeleteTextures();
+    DeleteUploadBuffers();
+
+    ScheduleFrame();  // This will trigger OnPaint to clear the canvas to dark grey
 }
 
 
 void ImageCanvas::LoadImage(const std::shared_ptr<Image> &image) {
     imagePreview->LoadImage(image);  // Load the image into ImagePreview
 
-    // Set the initial LOD level to LOW and get the image for display
-    imagePreview->SetLodLevel(ImagePreview::LodLevel::LOW);
+    // Start with the base level, which is built on load, and get the image for display
+    currentLodLevel = imagePreview->GetLodLevel();
 
     imageLoaded = true;
     UpdateTexture();  // Update OpenGL texture based on the new image
     FitImageToCanvas();
-    Refresh();
+    ScheduleFrame();
 }
 
 
 void ImageCanvas::SetZoomLevel(float zoom) {
     zoomFactor = std::clamp(zoom, MIN_ZOOM_FACTOR, MAX_ZOOM_FACTOR);
     UpdateLodLevel();  // Update LOD level based on the zoom factor
-    Refresh();
+    ScheduleFrame();
 }
 
 
 void ImageCanvas::CenterImageOnCanvas() {
     wxSize clientSize = GetClientSize();
-    auto high_size = imagePreview->GetSize(ImagePreview::LodLevel::HIGH);
-    float scaledWidth = high_size.width * zoomFactor;
-    float scaledHeight = high_size.height * zoomFactor;
+    auto full_size = imagePreview->GetFullSize();
+    float scaledWidth = full_size.width * zoomFactor;
+    float scaledHeight = full_size.height * zoomFactor;
 
     offsetX = (clientSize.GetWidth() - scaledWidth) / 2.0f;
     offsetY = (clientSize.GetHeight() - scaledHeight) / 2.0f;
 
-    Refresh();
+    ScheduleFrame();
 }
 
 
@@ -88,9 +144,9 @@ void ImageCanvas::FitImageToCanvas() {
 
     wxSize clientSize = GetClientSize();
     int paddingPx = 100;
-    auto high_size = imagePreview->GetSize(ImagePreview::LodLevel::HIGH);
-    float scaleX = static_cast<float>(clientSize.GetWidth()) / (high_size.width + paddingPx);
-    float scaleY = static_cast<float>(clientSize.GetHeight()) / (high_size.height + paddingPx);
+    auto full_size = imagePreview->GetFullSize();
+    float scaleX = static_cast<float>(clientSize.GetWidth()) / (full_size.width + paddingPx);
+    float scaleY = static_cast<float>(clientSize.GetHeight()) / (full_size.height + paddingPx);
     zoomFactor = std::min(scaleX, scaleY);
 
     UpdateLodLevel();  // Update the LOD level after fitting the image
@@ -99,20 +155,40 @@ void ImageCanvas::FitImageToCanvas() {
 
 
 void ImageCanvas::UpdateLodLevel() {
-    ImagePreview::LodLevel newLodLevel;
-
-    if (zoomFactor <= 0.5f) {
-        newLodLevel = ImagePreview::LodLevel::LOW;
-    } else if (zoomFactor <= 1.5f) {
-        newLodLevel = ImagePreview::LodLevel::MEDIUM;
-    } else {
-        newLodLevel = ImagePreview::LodLevel::HIGH;
+    // The zoom factor maps full resolution pixels to logical pixels, the content scale to physical screen pixels
+    float pixelDensity = zoomFactor * static_cast<float>(GetContentScaleFactor());
+    ImagePreview::LodLevel newLodLevel = imagePreview->GetLodLevelForScale(pixelDensity);
+
+    // The tiles are mipmapped, so the current level stays sharp over a range of zooms. It is only left once it gets
+    // blurry or too many of its pixels fall on each screen pixel.
+    if (currentLodLevel < imagePreview->GetLodCount() && pixelDensity > 0.0f) {
+        float lodPixelsPerScreenPixel = static_cast<float>(imagePreview->GetSize(currentLodLevel).width) /
+                                        (imagePreview->GetFullSize().width * pixelDensity);
+
+        if (lodPixelsPerScreenPixel >= MIN_LOD_PIXELS_PER_SCREEN_PIXEL &&
+            lodPixelsPerScreenPixel <= MAX_LOD_PIXELS_PER_SCREEN_PIXEL) {
+            newLodLevel = currentLodLevel;
+        }
     }
 
     if (newLodLevel != currentLodLevel) {
         currentLodLevel = newLodLevel;
-        imagePreview->SetLodLevel(currentLodLevel);  // Inform ImagePreview of the new LOD level
-        UpdateTexture();  // Update the OpenGL texture with the new LOD image
+
+        // Called from a worker thread once a LOD that was not built yet is ready
+        auto onLodReady = [this, newLodLevel]() {
+            CallAfter([this, newLodLevel]() {
+                if (newLodLevel == currentLodLevel && imagePreview->SetLodLevel(currentLodLevel)) {
+                    UpdateTexture();
+                    UpdateVisibleRegion();
+                    ScheduleFrame();
+                }
+            });
+        };
+
+        // Inform ImagePreview of the new LOD level, the lower LOD stays on screen while the new one is built
+        if (imagePreview->SetLodLevel(currentLodLevel, onLodReady)) {
+            UpdateTexture();  // Update the OpenGL texture with the new LOD image
+        }
     }
 }
 
@@ -143,11 +219,14 @@ void ImageCanvas::OnPaint(wxPaintEvent &evt) {
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    if (!imageLoaded || textureId == 0) {
+    if (!imageLoaded) {
         SwapBuffers();  // Apply the clear operation
         return;
     }
 
+    // Everything that changed since the last paint is uploaded at once
+    ApplyTextureUpdates();
+
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
 
@@ -161,18 +240,49 @@ void ImageCanvas::OnPaint(wxPaintEvent &evt) {
     glScalef(zoomFactor, zoomFactor, 1.0f);
 
     glEnable(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, textureId);
 
-    auto high_size = imagePreview->GetSize(ImagePreview::LodLevel::HIGH);
-    glBegin(GL_QUADS);
-    glTexCoord2f(0.0f, 0.0f); glVertex2f(0.0f, 0.0f);
-    glTexCoord2f(1.0f, 0.0f); glVertex2f(high_size.width, 0.0f);
-    glTexCoord2f(1.0f, 1.0f); glVertex2f(high_size.width, high_size.height);
-    glTexCoord2f(0.0f, 1.0f); glVertex2f(0.0f, high_size.height);
-    glEnd();
+    // The shader adjusts the original tiles, the lookup table stays bound to the second unit
+    bool useShader = shaderParameters != nullptr;
+
+    if (useShader) {
+        glUseProgram(lutProgram);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_3D, lutTexture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // Tiles are placed in full resolution coordinates, every LOD covers the full resolution image
+    auto fullSize = imagePreview->GetFullSize();
+    auto lodSize = imagePreview->GetSize();
+    float scaleX = static_cast<float>(fullSize.width) / lodSize.width;
+    float scaleY = static_cast<float>(fullSize.height) / lodSize.height;
+
+    for (const TextureTile* tile : PrepareVisibleTiles(useShader)) {
+        float left = tile->rect.x * scaleX;
+        float top = tile->rect.y * scaleY;
+        float right = tile->rect.br().x * scaleX;
+        float bottom = tile->rect.br().y * scaleY;
+
+        glBindTexture(GL_TEXTURE_2D, tile->id);
+
+        glBegin(GL_QUADS);
+        glTexCoord2f(0.0f, 0.0f); glVertex2f(left, top);
+        glTexCoord2f(1.0f, 0.0f); glVertex2f(right, top);
+        glTexCoord2f(1.0f, 1.0f); glVertex2f(right, bottom);
+        glTexCoord2f(0.0f, 1.0f); glVertex2f(left, bottom);
+        glEnd();
+    }
 
+    glBindTexture(GL_TEXTURE_2D, 0);
     glDisable(GL_TEXTURE_2D);
 
+    if (useShader) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_3D, 0);
+        glActiveTexture(GL_TEXTURE0);
+        glUseProgram(0);
+    }
+
     SwapBuffers();
 }
 
@@ -189,6 +299,9 @@ void ImageCanvas::OnMouseDown(wxMouseEvent &event) {
         dragStartPos = event.GetPosition();
         lastOffsetX = offsetX;
         lastOffsetY = offsetY;
+        lastMovePos = dragStartPos;
+        lastMoveTime = std::chrono::steady_clock::now();
+        viewportVelocity = cv::Point2f(0.0f, 0.0f);
     }
 }
 
@@ -197,6 +310,9 @@ void ImageCanvas::OnMouseUp(wxMouseEvent &event) {
     if (event.LeftUp()) {
         SetCursor(wxCursor(wxCURSOR_DEFAULT));
         isDragging = false;
+
+        // Keep prefetching in the direction of the last pan while the mouse rests
+        PrefetchAroundVisibleRegion();
     }
 }
 
@@ -213,7 +329,23 @@ void ImageCanvas::OnMouseMove(wxMouseEvent &event) {
         offsetX = lastOffsetX + deltaX;
         offsetY = lastOffsetY + deltaY;
 
-        Refresh();  // Redraw the canvas after panning
+        // The viewport moves opposite to the dragged image
+        auto now = std::chrono::steady_clock::now();
+        float elapsedSeconds = std::chrono::duration<float>(now - lastMoveTime).count();
+
+        if (elapsedSeconds > 0.0f) {
+            cv::Point2f velocity((lastMovePos.x - currentPos.x) / elapsedSeconds,
+                                 (lastMovePos.y - currentPos.y) / elapsedSeconds);
+            viewportVelocity.x = VELOCITY_SMOOTHING * viewportVelocity.x + (1.0f - VELOCITY_SMOOTHING) * velocity.x;
+            viewportVelocity.y = VELOCITY_SMOOTHING * viewportVelocity.y + (1.0f - VELOCITY_SMOOTHING) * velocity.y;
+        }
+
+        lastMovePos = currentPos;
+        lastMoveTime = now;
+
+        UpdateVisibleRegion();
+        PrefetchAroundVisibleRegion();
+        ScheduleFrame();  // Redraw the canvas after panning
     }
 }
 
@@ -239,7 +371,34 @@ void ImageCanvas::OnGestureZoom(wxZoomGestureEvent &evt) {
         zoomCallback(zoomFactor);  // Notify zoom change
     }
 
-    Refresh();  // Redraw canvas after zoom
+    UpdateVisibleRegion();
+    PrefetchAroundVisibleRegion(zoomDelta);
+    ScheduleFrame();  // Redraw canvas after zoom
+}
+
+
+void ImageCanvas::UpdateVisibleRegion() {
+    if (!imageLoaded || !visibleRegionCallback) {
+        return;
+    }
+
+    visibleRegionCallback(GetVisibleImageRegion());
+}
+
+
+void ImageCanvas::PrefetchAroundVisibleRegion(float zoomRate) {
+    if (!imageLoaded) {
+        return;
+    }
+
+    // Called from the prefetch worker thread
+    auto onPrefetched = [this]() {
+        CallAfter([this]() {
+            UpdateTexture();
+        });
+    };
+
+    imagePreview->PrefetchAroundRegion(GetVisibleImageRegion(), viewportVelocity, zoomRate, onPrefetched);
 }
 
 
@@ -248,29 +407,461 @@ void ImageCanvas::UpdateTexture() {
         return;
     }
 
-    SetCurrent(*glContext);
+    // Repeated updates until the next paint take the changes once
+    textureUpdatePending = true;
+    ScheduleFrame();
+}
+
 
-    if (textureId) {
-        glDeleteTextures(1, &textureId);
+void ImageCanvas::UpdateTexture(const ImagePreview::Frame& frame) {
+    pendingFrames.push_back(frame);
+    ScheduleFrame();
+}
+
+
+void ImageCanvas::ScheduleFrame() {
+    if (frameTimer.IsRunning()) {
+        framePending = true;
+        return;
+    }
+
+    // Nothing painted for a frame or longer, paint right away and pace the requests that follow
+    Refresh(false);
+    frameTimer.Start(FRAME_INTERVAL_MS);
+}
+
+
+void ImageCanvas::OnFrameTimer(wxTimerEvent &evt) {
+    if (framePending) {
+        framePending = false;
+        Refresh(false);
+        return;
+    }
+
+    // Keep ticking while a frame is on its way, the user waits for it
+    if (busyCallback && busyCallback()) {
+        return;
+    }
+
+    frameTimer.Stop();
+}
+
+
+void ImageCanvas::ApplyTextureUpdates() {
+    // Rendered frames first, their changes are older than the ones still in the preview
+    for (const auto& frame : pendingFrames) {
+        UploadFrame(frame);
+    }
+
+    pendingFrames.clear();
+
+    if (textureUpdatePending) {
+        textureUpdatePending = false;
+        UploadFrame(imagePreview->GetFrame(GetVisibleImageRegion()));
+    }
+}
+
+
+void ImageCanvas::UploadFrame(const ImagePreview::Frame& frame) {
+    bool fromUploadBuffer = frame.upload_buffer >= 0 && uploadBufferPool->Return(frame.upload_buffer);
+
+    // The buffer has been unmapped since the frame was written into it, the pixels are gone
+    if (frame.upload_buffer >= 0 && !fromUploadBuffer) {
+        return;
     }
 
-    glGenTextures(1, &textureId);
-    glBindTexture(GL_TEXTURE_2D, textureId);
+    if (!imageLoaded || frame.size.empty()) {
+        // Still mapped, offered again as it is
+        if (fromUploadBuffer) {
+            const UploadBuffer& uploadBuffer = uploadBuffers[frame.upload_buffer];
+            uploadBufferPool->Offer({frame.upload_buffer, uploadBuffer.mapped, uploadBuffer.capacity});
+        }
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return;
+    }
 
-    // Lock the mutex before accessing the image
-    {
-        std::shared_lock<std::shared_mutex> lock(imagePreview->GetLodImageMutex());  // Use shared_lock for reading
-        auto img = imagePreview->GetImage();  // Safely get the image
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, img.cols, img.rows, 0, GL_RGBA, GL_UNSIGNED_BYTE, img.data);
+    SetCurrent(*glContext);
+
+    // Only resident tiles are updated, the others are uploaded when they become visible. Tiles with changes
+    // outside of the pixels of the frame are stale and dropped.
+    std::vector<const TextureTile*> updatedTiles;
+
+    for (auto tile = textureTiles.begin(); tile != textureTiles.end();) {
+        cv::Rect changed = tile->second.rect & frame.changed_region;
+
+        // Original tiles never change
+        if (std::get<0>(tile->first) != frame.lod_level || std::get<2>(tile->first) || changed.empty()) {
+            ++tile;
+        } else if ((tile->second.rect & frame.region) == changed) {
+            updatedTiles.push_back(&tile->second);
+            ++tile;
+        } else {
+            glDeleteTextures(1, &tile->second.id);
+            tile = textureTiles.erase(tile);
+        }
+    }
+
+    if (fromUploadBuffer && !updatedTiles.empty()) {
+        // The worker has written the pixels into the mapped buffer already. Unmapping hands them to the driver,
+        // which copies them into the tiles asynchronously.
+        UploadBuffer& uploadBuffer = uploadBuffers[frame.upload_buffer];
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer.id);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        uploadBuffer.mapped = nullptr;
+
+        // Offsets into the bound buffer take the place of pointers
+        for (const TextureTile* tile : updatedTiles) {
+            UploadToTile(*tile, frame.region, nullptr, frame.region.width);
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    } else if (fromUploadBuffer) {
+        // Nothing to upload, the buffer is still mapped and can be offered again as it is
+        const UploadBuffer& uploadBuffer = uploadBuffers[frame.upload_buffer];
+        uploadBufferPool->Offer({frame.upload_buffer, uploadBuffer.mapped, uploadBuffer.capacity});
+    } else {
+        // The pixels may be a view into the whole LOD image, with its row length
+        for (const TextureTile* tile : updatedTiles) {
+            UploadToTile(*tile, frame.region, frame.pixels.data, frame.pixels.step / frame.pixels.elemSize());
+        }
     }
 
+    // Room for the RGBA pixels of the visible region at up to two LOD pixels per screen pixel. Larger frames of a
+    // minified level are copied instead.
+    wxSize clientSize = GetClientSize();
+    double lodPixelsPerScreenPixel = 2.0 * GetContentScaleFactor();
+    OfferUploadBuffers(static_cast<size_t>(clientSize.GetWidth() * lodPixelsPerScreenPixel + 8) *
+                       static_cast<size_t>(clientSize.GetHeight() * lodPixelsPerScreenPixel + 8) * 4);
+}
+
+
+void ImageCanvas::UploadToTile(const TextureTile& tile, const cv::Rect& region, const uint8_t* pixels, size_t rowLength) {
+    // Pixels start at the top left corner of the region, with rowLength pixels per row.
+    // They are null when they come from a bound pixel buffer, the offset is then all that counts.
+    cv::Rect overlap = tile.rect & region;
+    size_t offset = ((overlap.y - region.y) * rowLength + (overlap.x - region.x)) * 4;
+    auto overlapPixels = reinterpret_cast<const void*>(reinterpret_cast<uintptr_t>(pixels) + offset);
+
+    glBindTexture(GL_TEXTURE_2D, tile.id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, static_cast<GLint>(rowLength));
+
+    glTexSubImage2D(GL_TEXTURE_2D, 0, overlap.x - tile.rect.x, overlap.y - tile.rect.y, overlap.width, overlap.height,
+                    GL_RGBA, GL_UNSIGNED_BYTE, overlapPixels);
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 
+int ImageCanvas::GetTextureTileSize() {
+    if (textureTileSize == 0) {
+        GLint maxTextureSize = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+        textureTileSize = maxTextureSize > 0 ? std::min(TEXTURE_TILE_SIZE, static_cast<int>(maxTextureSize)) : TEXTURE_TILE_SIZE;
+    }
+
+    return textureTileSize;
+}
+
+
+std::vector<const ImageCanvas::TextureTile*> ImageCanvas::PrepareVisibleTiles(bool original) {
+    // Expects the GL context to be current
+    ImagePreview::LodLevel lodLevel = imagePreview->GetLodLevel();
+    cv::Size lodSize = imagePreview->GetSize();
+    cv::Rect visibleRegion = GetVisibleImageRegion() & cv::Rect(0, 0, lodSize.width, lodSize.height);
+    std::vector<const TextureTile*> visibleTiles;
+
+    paintCounter++;
+
+    if (visibleRegion.empty()) {
+        return visibleTiles;
+    }
+
+    int tileSize = GetTextureTileSize();
+    int tilesX = (lodSize.width + tileSize - 1) / tileSize;
+
+    for (int tileY = visibleRegion.y / tileSize; tileY <= (visibleRegion.br().y - 1) / tileSize; tileY++) {
+        for (int tileX = visibleRegion.x / tileSize; tileX <= (visibleRegion.br().x - 1) / tileSize; tileX++) {
+            TextureTileKey key(lodLevel, tileY * tilesX + tileX, original);
+            auto tile = textureTiles.find(key);
+
+            if (tile == textureTiles.end()) {
+                cv::Rect rect = cv::Rect(tileX * tileSize, tileY * tileSize, tileSize, tileSize) &
+                                cv::Rect(0, 0, lodSize.width, lodSize.height);
+                ImagePreview::Frame frame = imagePreview->GetRegion(rect, original);
+
+                // The preview has switched to another level in the meantime
+                if (frame.lod_level != lodLevel || frame.region != rect) {
+                    continue;
+                }
+
+                TextureTile newTile;
+                newTile.rect = rect;
+                glGenTextures(1, &newTile.id);
+                glBindTexture(GL_TEXTURE_2D, newTile.id);
+
+                // Trilinear between the mip levels, which the driver rebuilds with every upload to the tile.
+                // GL_GENERATE_MIPMAP rather than glGenerateMipmap, which legacy contexts do not have.
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, MAX_TEXTURE_MIP_LEVEL);
+                glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
+
+                // Clamped, so that tiles do not blend in the opposite edge
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, static_cast<GLint>(frame.pixels.step / frame.pixels.elemSize()));
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, rect.width, rect.height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                             frame.pixels.data);
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+                glBindTexture(GL_TEXTURE_2D, 0);
+
+                tile = textureTiles.emplace(key, newTile).first;
+            }
+
+            tile->second.lastDrawn = paintCounter;
+            visibleTiles.push_back(&tile->second);
+        }
+    }
+
+    EvictTextureTiles();
+    return visibleTiles;
+}
+
+
+void ImageCanvas::EvictTextureTiles() {
+    // Least recently drawn first. Tiles of the current paint stay, even if the viewport needs more than the limit.
+    while (textureTiles.size() > MAX_RESIDENT_TEXTURE_TILES) {
+        auto oldest = textureTiles.end();
+
+        for (auto tile = textureTiles.begin(); tile != textureTiles.end(); ++tile) {
+            if (tile->second.lastDrawn < paintCounter &&
+                (oldest == textureTiles.end() || tile->second.lastDrawn < oldest->second.lastDrawn)) {
+                oldest = tile;
+            }
+        }
+
+        if (oldest == textureTiles.end()) {
+            break;
+        }
+
+        glDeleteTextures(1, &oldest->second.id);
+        textureTiles.erase(oldest);
+    }
+}
+
+
+void ImageCanvas::OfferUploadBuffers(size_t bytes) {
+    if (bytes == 0) {
+        return;
+    }
+
+    if (uploadBuffers[0].id == 0) {
+        for (auto& uploadBuffer : uploadBuffers) {
+            glGenBuffers(1, &uploadBuffer.id);
+        }
+    }
+
+    // Buffers that are too small are mapped again once no worker holds them
+    if (bytes > uploadBufferCapacity) {
+        for (const auto& buffer : uploadBufferPool->Reclaim()) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffers[buffer.index].id);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            uploadBuffers[buffer.index].mapped = nullptr;
+        }
+
+        uploadBufferCapacity = bytes;
+    }
+
+    for (int index = 0; index < UPLOAD_BUFFER_COUNT; index++) {
+        UploadBuffer& uploadBuffer = uploadBuffers[index];
+
+        if (uploadBuffer.mapped) {
+            continue;
+        }
+
+        // New storage for every map, so that mapping never waits for the previous transfer from the buffer
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer.id);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(uploadBufferCapacity), nullptr, GL_STREAM_DRAW);
+        uploadBuffer.mapped = static_cast<uint8_t*>(glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY));
+        uploadBuffer.capacity = uploadBufferCapacity;
+
+        if (uploadBuffer.mapped) {
+            uploadBufferPool->Offer({index, uploadBuffer.mapped, uploadBuffer.capacity});
+        }
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+
+void ImageCanvas::DeleteUploadBuffers() {
+    if (uploadBuffers[0].id == 0) {
+        return;
+    }
+
+    // A worker may still write into a taken buffer, which must stay mapped until it is done
+    SetCurrent(*glContext);
+    uploadBufferPool->Drain();
+
+    for (auto& uploadBuffer : uploadBuffers) {
+        if (uploadBuffer.mapped) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer.id);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            uploadBuffer.mapped = nullptr;
+        }
+
+        glDeleteBuffers(1, &uploadBuffer.id);
+        uploadBuffer.id = 0;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    uploadBufferCapacity = 0;
+}
+
+
+bool ImageCanvas::ShowAdjustmentsWithShader(const std::shared_ptr<AdjustmentsParameters>& parameters) {
+    if (!imageLoaded || !parameters) {
+        return false;
+    }
+
+    auto lookupTable = Image::BakeLookupTable(*parameters);
+
+    SetCurrent(*glContext);
+
+    if (!lookupTable || !InitLookupTableShader()) {
+        // The adjusted tiles are shown again, until the CPU pipeline catches up they lag behind the slider
+        if (shaderParameters) {
+            shaderParameters.reset();
+            ScheduleFrame();
+        }
+
+        return false;
+    }
+
+    // A few hundred KB per slider tick instead of processing and uploading the visible region
+    int latticeSize = ColorLookupTable3D::LATTICE_SIZE;
+    glBindTexture(GL_TEXTURE_3D, lutTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB8, latticeSize, latticeSize, latticeSize, 0, GL_RGB, GL_UNSIGNED_BYTE,
+                 lookupTable->GetTable().data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    shaderParameters = parameters;
+    ScheduleFrame();
+    return true;
+}
+
+
+void ImageCanvas::EndShaderAdjustments(const std::shared_ptr<AdjustmentsParameters>& processedParameters) {
+    // Frames of parameters the slider has moved past do not end it
+    if (shaderParameters && shaderParameters == processedParameters) {
+        shaderParameters.reset();
+        ScheduleFrame();
+    }
+}
+
+
+bool ImageCanvas::InitLookupTableShader() {
+    // Expects the GL context to be current
+    if (lutProgram != 0) {
+        return true;
+    }
+
+    if (lutShaderFailed) {
+        return false;
+    }
+
+    // Only tried once, the CPU pipeline is used from then on
+    lutShaderFailed = true;
+
+    GLuint vertexShader = CompileShader(GL_VERTEX_SHADER, LUT_VERTEX_SHADER);
+    GLuint fragmentShader = CompileShader(GL_FRAGMENT_SHADER, LUT_FRAGMENT_SHADER);
+
+    if (vertexShader == 0 || fragmentShader == 0) {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return false;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glLinkProgram(program);
+
+    // Flagged for deletion, they go with the program
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+
+    if (linked != GL_TRUE) {
+        char log[1024] = {0};
+        glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+        std::cerr << "Failed to link shader program: " << log << std::endl;
+        glDeleteProgram(program);
+        return false;
+    }
+
+    float latticeSize = static_cast<float>(ColorLookupTable3D::LATTICE_SIZE);
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "image"), 0);
+    glUniform1i(glGetUniformLocation(program, "lookupTable"), 1);
+    glUniform1f(glGetUniformLocation(program, "latticeScale"), (latticeSize - 1.0f) / latticeSize);
+    glUniform1f(glGetUniformLocation(program, "latticeOffset"), 0.5f / latticeSize);
+    glUseProgram(0);
+
+    // Interpolated between the lattice points, trilinear on the GPU where the CPU is tetrahedral
+    glGenTextures(1, &lutTexture);
+    glBindTexture(GL_TEXTURE_3D, lutTexture);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    lutProgram = program;
+    lutShaderFailed = false;
+    return true;
+}
+
+
+void ImageCanvas::DeleteLookupTableShader() {
+    if (lutProgram == 0) {
+        return;
+    }
+
+    SetCurrent(*glContext);
+    glDeleteProgram(lutProgram);
+    glDeleteTextures(1, &lutTexture);
+    lutProgram = 0;
+    lutTexture = 0;
+}
+
+
+void ImageCanvas::DeleteTextures() {
+    if (textureTiles.empty()) {
+        return;
+    }
+
+    SetCurrent(*glContext);
+
+    for (auto& tile : textureTiles) {
+        glDeleteTextures(1, &tile.second.id);
+    }
+
+    textureTiles.clear();
+}
+
+
 cv::Rect ImageCanvas::GetVisibleImageRegion() {
     if (!imageLoaded) {
         return cv::Rect();  // Return an empty rectangle if no image is loaded
@@ -279,38 +870,38 @@ cv::Rect ImageCanvas::GetVisibleImageRegion() {
     // Get the size of the visible canvas area (viewport size)
     wxSize clientSize = GetClientSize();
 
-    // Get the size of the high LOD image
-    auto highLodSize = imagePreview->GetSize(ImagePreview::LodLevel::HIGH);
+    // Get the size of the full resolution image
+    auto fullSize = imagePreview->GetFullSize();
 
-    // Get the size of the currently displayed LOD image
-    auto currentLodSize = imagePreview->GetSize(currentLodLevel);
+    // Get the size of the currently displayed LOD image, which lags behind currentLodLevel while a LOD is built
+    auto currentLodSize = imagePreview->GetSize();
 
-    // Compute the scale factor between the high LOD size and the current LOD size
-    float scaleX = static_cast<float>(currentLodSize.width) / highLodSize.width;
-    float scaleY = static_cast<float>(currentLodSize.height) / highLodSize.height;
+    // Compute the scale factor between the full resolution size and the current LOD size
+    float scaleX = static_cast<float>(currentLodSize.width) / fullSize.width;
+    float scaleY = static_cast<float>(currentLodSize.height) / fullSize.height;
 
     // Correct the offset values to account for zoom factor
     // Offsets are negative when the image is scrolled to the left or top
     float imageXStart = (-offsetX) / zoomFactor;
     float imageYStart = (-offsetY) / zoomFactor;
 
-    // Calculate the size of the visible region in image coordinates relative to the high LOD image
+    // Calculate the size of the visible region in image coordinates relative to the full resolution image
     float visibleWidth = clientSize.GetWidth() / zoomFactor;
     float visibleHeight = clientSize.GetHeight() / zoomFactor;
 
-    // Clamp the starting coordinates to ensure they are within the high LOD image bounds
-    float highLodXStart = std::clamp(imageXStart, 0.0f, static_cast<float>(highLodSize.width));
-    float highLodYStart = std::clamp(imageYStart, 0.0f, static_cast<float>(highLodSize.height));
+    // Clamp the starting coordinates to ensure they are within the full resolution image bounds
+    float fullXStart = std::clamp(imageXStart, 0.0f, static_cast<float>(fullSize.width));
+    float fullYStart = std::clamp(imageYStart, 0.0f, static_cast<float>(fullSize.height));
 
-    // Adjust the width and height to ensure the visible region fits within the high LOD image bounds
-    float highLodWidth = std::clamp(visibleWidth, 0.0f, static_cast<float>(highLodSize.width - highLodXStart));
-    float highLodHeight = std::clamp(visibleHeight, 0.0f, static_cast<float>(highLodSize.height - highLodYStart));
+    // Adjust the width and height to ensure the visible region fits within the full resolution image bounds
+    float fullWidth = std::clamp(visibleWidth, 0.0f, static_cast<float>(fullSize.width - fullXStart));
+    float fullHeight = std::clamp(visibleHeight, 0.0f, static_cast<float>(fullSize.height - fullYStart));
 
-    // Scale the high LOD coordinates and dimensions to the current LOD level using floating point arithmetic
-    float scaledX = highLodXStart * scaleX;
-    float scaledY = highLodYStart * scaleY;
-    float scaledWidth = highLodWidth * scaleX;
-    float scaledHeight = highLodHeight * scaleY;
+    // Scale the full resolution coordinates and dimensions to the current LOD level using floating point arithmetic
+    float scaledX = fullXStart * scaleX;
+    float scaledY = fullYStart * scaleY;
+    float scaledWidth = fullWidth * scaleX;
+    float scaledHeight = fullHeight * scaleY;
 
     // Final casting to integer right before returning the values
     int x = static_cast<int>(std::floor(scaledX));
@@ -321,10 +912,10 @@ cv::Rect ImageCanvas::GetVisibleImageRegion() {
     // Log debug information for diagnostics
     std::cout << "Viewport: " << clientSize.GetWidth() << "x" << clientSize.GetHeight()
               << ", Zoom: " << zoomFactor << ", Offset: (" << offsetX << ", " << offsetY << ")"
-              << ", High LOD Image size: " << highLodSize.width << "x" << highLodSize.height
+              << ", Full Image size: " << fullSize.width << "x" << fullSize.height
               << ", Current LOD Image size: " << currentLodSize.width << "x" << currentLodSize.height
-              << ", Visible region in High LOD: (" << highLodXStart << ", " << highLodYStart << ", "
-              << highLodWidth << ", " << highLodHeight << ")"
+              << ", Visible region in Full Image: (" << fullXStart << ", " << fullYStart << ", "
+              << fullWidth << ", " << fullHeight << ")"
               << ", Visible region in Current LOD: (" << x << ", " << y << ", " << width << ", " << height << ")"
               << std::endl;
 
@@ -4,9 +4,13 @@
 #include <wx/wx.h>
 #include <wx/glcanvas.h>
 #include <opencv2/opencv.hpp>
+#include <chrono>
+#include <map>
+#include <tuple>
 
 #include "../ImagePreview.h"
 #include "../Image.h"
+#include "../UploadBufferPool.h"
 
 
 class ImageCanvas : public wxGLCanvas
@@ -38,7 +42,32 @@ public:
 
     cv::Rect GetVisibleImageRegion();
 
-    void UpdateTexture();               // Update OpenGL texture
+    // Mapped pixel buffers for workers that produce frames, see UploadBufferPool
+    std::shared_ptr<UploadBufferPool> GetUploadBufferPool() const { return uploadBufferPool; }
+
+    // Start processing the tiles around the viewport in the background
+    void PrefetchAroundVisibleRegion(float zoomRate = 1.0f);
+
+    // Texture updates are deferred to the next paint, see ScheduleFrame
+    void UpdateTexture();               // Upload what changed in the displayed LOD
+    void UpdateTexture(const ImagePreview::Frame& frame);  // Upload the changed region of a rendered frame
+
+    // Repaint with the next display frame. Requests until then are coalesced into a single paint.
+    void ScheduleFrame();
+
+    // Tells whether processing is in flight, the frame timer keeps ticking until it is not
+    void SetBusyCallback(std::function<bool()> callback) { busyCallback = callback; }
+
+    // Newly exposed parts of the preview are processed off the UI thread, the result comes back as a frame
+    void SetVisibleRegionCallback(std::function<void(const cv::Rect&)> callback) { visibleRegionCallback = callback; }
+
+    // Show the adjustments right away by drawing the original tiles through a lookup table in a fragment shader.
+    // False if the adjustments are not point-wise or shaders are not available, frames of the CPU pipeline are
+    // shown then.
+    bool ShowAdjustmentsWithShader(const std::shared_ptr<AdjustmentsParameters>& parameters);
+
+    // Back to the frames of the CPU pipeline, once it has processed the parameters the shader shows
+    void EndShaderAdjustments(const std::shared_ptr<AdjustmentsParameters>& processedParameters);
 
 protected:
     void OnPaint(wxPaintEvent& evt);
@@ -52,24 +81,91 @@ protected:
     // Gesture event handlers for zooming and panning
     void OnGestureZoom(wxZoomGestureEvent& evt);
 
+    void OnFrameTimer(wxTimerEvent& evt);
+
 private:
+    // The displayed LOD is drawn as a grid of texture tiles. Only tiles in the viewport are uploaded, they stay
+    // resident and are updated in place until they have not been drawn for a while.
+    struct TextureTile {
+        GLuint id = 0;
+        cv::Rect rect;          // In pixels of its LOD level
+        uint64_t lastDrawn = 0; // Paint counter
+    };
+
+    // Level, row-major tile index and whether the tile holds original or adjusted pixels
+    using TextureTileKey = std::tuple<ImagePreview::LodLevel, int, bool>;
+
     void UpdateLodLevel();              // Update the LOD level based on zoom
+    void UpdateVisibleRegion();         // Process newly exposed parts of the preview after a pan or zoom
+    void DeleteTextures();
+    void ApplyTextureUpdates();         // Uploads the deferred texture updates, expects the GL context to be current
+    void UploadFrame(const ImagePreview::Frame& frame);
+    int GetTextureTileSize();
+    std::vector<const TextureTile*> PrepareVisibleTiles(bool original);  // Uploads the visible tiles that are not resident
+    void UploadToTile(const TextureTile& tile, const cv::Rect& region, const uint8_t* pixels, size_t rowLength);
+    void EvictTextureTiles();
+    void OfferUploadBuffers(size_t bytes);      // Map the idle upload buffers with room for the bytes
+    void DeleteUploadBuffers();
+    bool InitLookupTableShader();
+    void DeleteLookupTableShader();
 
     std::shared_ptr<ImagePreview> imagePreview;  // ImagePreview object
     bool imageLoaded;                   // Flag to check if an image is loaded
-    GLuint textureId;                   // OpenGL texture ID
     wxGLContext* glContext;             // OpenGL context
 
+    std::map<TextureTileKey, TextureTile> textureTiles;
+    int textureTileSize;                // Limited by GL_MAX_TEXTURE_SIZE, 0 until queried
+    uint64_t paintCounter;
+
+    // Double-buffered pixel buffer objects. While one transfers a frame to its texture, a worker writes the next
+    // frame into the other.
+    struct UploadBuffer {
+        GLuint id = 0;
+        uint8_t* mapped = nullptr;  // Set while the buffer is mapped, i.e. offered to or taken by a worker
+        size_t capacity = 0;
+    };
+
+    static constexpr int UPLOAD_BUFFER_COUNT = 2;
+    UploadBuffer uploadBuffers[UPLOAD_BUFFER_COUNT];
+    size_t uploadBufferCapacity;                // Capacity of newly mapped buffers
+    std::shared_ptr<UploadBufferPool> uploadBufferPool;
+
+    // While a slider moves, the original tiles are drawn through the adjustments baked into a 3D texture
+    GLuint lutProgram;
+    GLuint lutTexture;
+    bool lutShaderFailed;               // Not available, e.g. no GLSL support, adjustments stay on the CPU
+    std::shared_ptr<AdjustmentsParameters> shaderParameters;  // Set while the shader shows these parameters
+
+    // Frame pacing: the first request after an idle period paints right away, the timer then ticks once per
+    // display frame while requests come in or processing is in flight
+    wxTimer frameTimer;
+    bool framePending;                  // A paint is requested for the next tick
+    bool textureUpdatePending;          // The changes of the displayed LOD are taken at paint time
+    std::vector<ImagePreview::Frame> pendingFrames;  // Rendered frames waiting for the next paint
+    std::function<bool()> busyCallback;
+    std::function<void(const cv::Rect&)> visibleRegionCallback;
+
     float zoomFactor;                   // Zoom factor for the image
     float offsetX, offsetY;             // Offset for panning
     bool isDragging;                    // Flag to track dragging state
     wxPoint dragStartPos;               // Initial mouse position for panning
     float lastOffsetX, lastOffsetY;     // Offset values before panning
+    wxPoint lastMovePos;                // Mouse position of the previous move event
+    std::chrono::steady_clock::time_point lastMoveTime;  // Time of the previous move event
+    cv::Point2f viewportVelocity;       // Smoothed viewport velocity in screen pixels per second
 
     std::function<void(float)> zoomCallback;  // Callback to update zoom level in status bar
 
-    static constexpr float MIN_ZOOM_FACTOR = 0.1f;  // Minimum zoom factor
+    static constexpr float MIN_ZOOM_FACTOR = 0.01f; // Minimum zoom factor, relative to the full resolution image
     static constexpr float MAX_ZOOM_FACTOR = 4.0f;  // Maximum zoom factor
+    static constexpr float VELOCITY_SMOOTHING = 0.5f;  // Weight of the previous velocity when smoothing
+    static constexpr int TEXTURE_TILE_SIZE = 512;
+    static constexpr size_t MAX_RESIDENT_TEXTURE_TILES = 192;   // 256 MB of mipmapped RGBA tiles, several viewports
+    static constexpr int MAX_TEXTURE_MIP_LEVEL = 2;     // Enough for the minification a level is kept for
+    // A level is kept while it has this many pixels per screen pixel, see UpdateLodLevel
+    static constexpr float MIN_LOD_PIXELS_PER_SCREEN_PIXEL = 0.8f;
+    static constexpr float MAX_LOD_PIXELS_PER_SCREEN_PIXEL = 2.5f;
+    static constexpr int FRAME_INTERVAL_MS = 16;    // One display frame at 60 Hz
 
     ImagePreview::LodLevel currentLodLevel;   // Current LOD level
 
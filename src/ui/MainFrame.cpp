@@ -1,8 +1,12 @@
 #include "MainFrame.h"
 #include "../ImageReader.h"
 #include "../MetadataReader.h"
+#include "../Utils.h"
+#include "../MemoryBudget.h"
 #include "LayerAdjustmentsPanel.h"
 
+#include <chrono>
+
 
 MainFrame::MainFrame(const wxString &title)
         : wxFrame(NULL, wxID_ANY, title, wxDefaultPosition, wxSize(800, 600)) {
@@ -13,6 +17,7 @@ MainFrame::MainFrame(const wxString &title)
 
     CreateMenuBar();
     CreateRightPanel();
+    CreatePreviewRenderer();
 
     rightPanel->Disable();  // Disable the right panel until an image is loaded
 
@@ -41,9 +46,56 @@ void MainFrame::CreateRightPanel() {
 }
 
 
+void MainFrame::CreatePreviewRenderer() {
+    previewRenderer = std::make_shared<PreviewRenderer>(imagePreview);
+    previewRenderer->SetUploadBufferPool(editor->GetImageCanvas()->GetUploadBufferPool());
+    editor->GetImageCanvas()->SetBusyCallback([this]() { return previewRenderer->IsBusy(); });
+
+    // Only the viewport changed, the pending parameters are kept
+    editor->GetImageCanvas()->SetVisibleRegionCallback([this](const cv::Rect &visibleRegion) {
+        PreviewRenderer::Request request;
+        request.visible_region = visibleRegion;
+        previewRenderer->Post(request);
+    });
+
+    // The callbacks are called on the render thread, hand the results over to the main thread
+    previewRenderer->SetFrameCallback([this](const ImagePreview::Frame &frame) {
+        this->CallAfter([this, frame]() {
+            editor->GetImageCanvas()->UpdateTexture(frame);
+            editor->GetImageCanvas()->EndShaderAdjustments(frame.parameters);
+            editor->GetImageCanvas()->PrefetchAroundVisibleRegion();
+        });
+    });
+
+    previewRenderer->SetHistogramCallback([this](const std::vector<cv::Mat> &histogram) {
+        this->CallAfter([this, histogram]() {
+            imageAnalysisPanel->GetHistogramCanvas()->SetHistogramData(histogram);
+
+            if (image) {
+                imageAnalysisPanel->GetImageInfoPanel()->SetData(image->GetImageInfo());
+            }
+        });
+    });
+
+    previewRenderer->SetLodCallback([this](ImagePreview::LodLevel lodLevel) {
+        std::cout << "LOD " << static_cast<int>(lodLevel) << " adjustments have been successfully applied!" << std::endl;
+
+        // Ensure UpdateTexture is called on the main thread
+        this->CallAfter([this, lodLevel]() {
+            // Other LODs are refined in the background and are shown once the canvas switches to them
+            if (lodLevel != editor->GetImagePreview()->GetLodLevel()) {
+                return;
+            }
+
+            editor->GetImageCanvas()->UpdateTexture();  // Shown with the next frame once the displayed LOD is done
+        });
+    });
+}
+
+
 void MainFrame::OnOpen(wxCommandEvent &event) {
     wxFileDialog openFileDialog(this, _("Open Image file"), "", "",
-                                "Image files (*.png;*.jpg;*.jpeg;*.bmp)|*.png;*.jpg;*.jpeg;*.bmp",
+                                "Image files (*.png;*.jpg;*.jpeg;*.bmp;*.tif;*.tiff)|*.png;*.jpg;*.jpeg;*.bmp;*.tif;*.tiff",
                                 wxFD_OPEN | wxFD_FILE_MUST_EXIST);
 
     if (openFileDialog.ShowModal() == wxID_CANCEL) {
@@ -53,6 +105,9 @@ void MainFrame::OnOpen(wxCommandEvent &event) {
     wxString filePath = openFileDialog.GetPath();
     std::string filename = filePath.ToStdString();
 
+    size_t residentMemoryBefore = Utils::GetResidentMemory();
+    size_t peakResidentMemoryBefore = Utils::GetPeakResidentMemory();
+
     auto imageUmat = std::make_shared<cv::UMat>();
 
     if (!ImageReader::Open(filename, imageUmat)) {
@@ -60,13 +115,34 @@ void MainFrame::OnOpen(wxCommandEvent &event) {
         return;
     }
 
+    // Nothing may render into the previous image while it is replaced
+    previewRenderer->WaitUntilIdle();
+
     image = std::make_shared<Image>(imageUmat);
     imageHistogram = std::make_shared<ImageHistogram>(imageUmat);
+    previewRenderer->SetHistogram(imageHistogram);
+
+    // Large originals are kept compressed, the preview works on its own LODs. Compressed before the preview
+    // shares the original, so that the uncompressed pixels are released with imageUmat.
+    if (static_cast<int64_t>(image->GetWidth()) * image->GetHeight() >= COMPRESS_ORIGINAL_MIN_PIXELS) {
+        auto compressStart = std::chrono::steady_clock::now();
+        image->CompressOriginal();
+        auto compressTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - compressStart);
+        std::cout << "Original compressed in " << compressTime.count() << " ms" << std::endl;
+    }
 
     editor->LoadImage(image);
     imageAnalysisPanel->GetHistogramCanvas()->SetHistogramData(imageHistogram->GetHistogram());
     imageAnalysisPanel->GetImageInfoPanel()->SetData(image->GetImageInfo());
 
+    std::cout << "Memory for " << filename << ": resident " << residentMemoryBefore / (1024 * 1024) << " MB -> "
+              << Utils::GetResidentMemory() / (1024 * 1024) << " MB, peak " << peakResidentMemoryBefore / (1024 * 1024)
+              << " MB -> " << Utils::GetPeakResidentMemory() / (1024 * 1024) << " MB" << std::endl;
+
+    for (const auto& [category, bytes] : MemoryBudget::GetInstance().GetUsedBytesPerCategory()) {
+        std::cout << "  " << MemoryBudget::GetCategoryName(category) << ": " << bytes / (1024 * 1024) << " MB" << std::endl;
+    }
+
     MetadataReader metadataReader;
     metadataReader.Load(filename);
     imageAnalysisPanel->GetExifMetadataPanel()->SetData(metadataReader.GetExifMetadata());
@@ -78,6 +154,7 @@ void MainFrame::OnOpen(wxCommandEvent &event) {
 
 
 void MainFrame::OnClose(wxCommandEvent &event) {
+    previewRenderer->WaitUntilIdle();
     editor->Disable();
     rightPanel->Disable();
     editor->Reset();
@@ -89,34 +166,31 @@ void MainFrame::OnClose(wxCommandEvent &event) {
 void MainFrame::OnAdjustmentSliderValueChanged(wxCommandEvent &event) {
     auto adjustments = static_cast<std::shared_ptr<AdjustmentsParameters>*>(event.GetClientData());
 
-    // Update visible region of the image
-    editor->GetImagePreview()->AdjustParameters(*adjustments);
-    cv::Rect visibleRegion = editor->GetImageCanvas()->GetVisibleImageRegion();
-    editor->GetImagePreview()->ApplyAdjustmentsForPreviewRegion(visibleRegion);
-    editor->GetImageCanvas()->UpdateTexture();
-    editor->GetImageCanvas()->Refresh();
+    // Point-wise adjustments are shown by the GPU while the slider moves, the CPU result follows on release
+    if (editor->GetImageCanvas()->ShowAdjustmentsWithShader(*adjustments)) {
+        return;
+    }
 
-    // Update histogram
-    imageHistogram->AdjustParameters(*adjustments);
-    imageHistogram->ApplyAdjustments();
-    imageAnalysisPanel->GetHistogramCanvas()->SetHistogramData(imageHistogram->GetHistogram());
-    imageAnalysisPanel->GetImageInfoPanel()->SetData(image->GetImageInfo());
+    // Rendered on the preview thread. A newer slider value replaces this one if it has not been started yet.
+    PreviewRenderer::Request request;
+    request.parameters = *adjustments;
+    request.visible_region = editor->GetImageCanvas()->GetVisibleImageRegion();
+    previewRenderer->Post(request);
 }
 
 
 void MainFrame::OnAdjustmentSliderMouseReleasedValueChanged(wxCommandEvent &event) {
-    auto onSuccess = [this]() {
-        std::cout << "All LOD adjustments have been successfully applied!" << std::endl;
+    auto adjustments = static_cast<std::shared_ptr<AdjustmentsParameters>*>(event.GetClientData());
 
-        // Ensure UpdateTexture is called on the main thread
-        this->CallAfter([this]() {
-            editor->GetImageCanvas()->UpdateTexture();  // Update the texture after all adjustments are done
-            editor->GetImageCanvas()->Refresh();        // Trigger a canvas refresh to see the changes
-        });
-    };
+    // The shader shows the final values until the preview thread has processed them
+    editor->GetImageCanvas()->ShowAdjustmentsWithShader(*adjustments);
 
-    // Update all LODs in the background
-    editor->GetImagePreview()->ApplyAdjustmentsForAllLodsAsync(onSuccess);  // Apply async adjustments
+    // Update all LODs in the background once the preview has the final values, the displayed LOD first
+    PreviewRenderer::Request request;
+    request.parameters = *adjustments;
+    request.visible_region = editor->GetImageCanvas()->GetVisibleImageRegion();
+    request.refine_lods = true;
+    previewRenderer->Post(request);
 }
 
 
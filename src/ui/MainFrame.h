@@ -7,6 +7,7 @@
 #include "../Image.h"
 #include "../ImageHistogram.h"
 #include "../ImagePreview.h"
+#include "../PreviewRenderer.h"
 #include "ImageEditor.h"
 #include "ImageAnalysisPanel.h"
 #include "ImageAdjustmentsPanel.h"
@@ -24,15 +25,19 @@ private:
 
     void CreateMenuBar();
     void CreateRightPanel();
+    void CreatePreviewRenderer();
 
 private:
     std::shared_ptr<ImagePreview> imagePreview;
+    std::shared_ptr<PreviewRenderer> previewRenderer;  // Runs slider changes off the UI thread
     ImageEditor *editor;
     wxPanel *rightPanel;
     ImageAnalysisPanel *imageAnalysisPanel;
     ImageAdjustmentsPanel *imageAdjustmentsPanel;
     std::shared_ptr<Image> image;
     std::shared_ptr<ImageHistogram> imageHistogram;
+
+    static constexpr int64_t COMPRESS_ORIGINAL_MIN_PIXELS = 16 * 1000 * 1000;  // Smaller originals stay uncompressed
 };
 
 